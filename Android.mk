@@ -13,30 +13,57 @@
 # limitations under the License.
 
 LOCAL_PATH := $(call my-dir)
-include $(CLEAR_VARS)
 
-LOCAL_SRC_FILES := \
+vulkan_hal_src_files := \
+	vulkan_acquire.cpp \
+	vulkan_arena.cpp \
+	vulkan_chain.cpp \
+	vulkan_device.cpp \
+	vulkan_driver.cpp \
+	vulkan_extensions.cpp \
+	vulkan_fence.cpp \
+	vulkan_format.cpp \
+	vulkan_gralloc.cpp \
 	vulkan_hal.cpp \
+	vulkan_image_cache.cpp \
+	vulkan_image_ring.cpp \
+	vulkan_import.cpp \
+	vulkan_instance.cpp \
+	vulkan_modifier.cpp \
+	vulkan_proc_cache.cpp \
+	vulkan_snapshot.cpp \
+	vulkan_stats.cpp \
+	vulkan_timing.cpp \
+	vulkan_usage.cpp \
 	vulkan_wrapper.cpp
 
-LOCAL_CLANG := true
-LOCAL_CFLAGS := -std=c99 -fvisibility=hidden -fstrict-aliasing \
+vulkan_hal_cflags := -std=c99 -fvisibility=hidden -fstrict-aliasing \
 	-Weverything -Werror \
 	-Wno-padded \
 	-Wno-undef \
 	-Wno-zero-length-array \
-	-DVK_USE_PLATFORM_ANDROID_KHR \
 	-DLOG_TAG=\"VulkanHAL\" \
-#LOCAL_CFLAGS += -DLOG_NDEBUG=0
-LOCAL_CPPFLAGS := -std=c++1y \
+#vulkan_hal_cflags += -DLOG_NDEBUG=0
+vulkan_hal_cppflags := -std=c++1y \
 	-Wno-c++98-compat-pedantic \
 	-Wno-c99-extensions
 
-LOCAL_C_INCLUDES := \
+vulkan_hal_c_includes := \
 	frameworks/native/vulkan/include \
 	$(LOCAL_PATH)/../mesa/include
 
-LOCAL_SHARED_LIBRARIES := libvulkan liblog libdl libcutils libsync
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := $(vulkan_hal_src_files)
+LOCAL_CLANG := true
+LOCAL_CFLAGS := $(vulkan_hal_cflags) -DVK_USE_PLATFORM_ANDROID_KHR
+LOCAL_CPPFLAGS := $(vulkan_hal_cppflags)
+LOCAL_C_INCLUDES := $(vulkan_hal_c_includes)
+
+LOCAL_SHARED_LIBRARIES := libvulkan liblog libdl libcutils libhardware libsync
+ifneq ($(VULKAN_HAL_SNAPSHOT),)
+LOCAL_REQUIRED_MODULES := vulkan_hal_snapshot_file
+endif
 
 LOCAL_MODULE := vulkan.$(TARGET_BOARD_PLATFORM)
 #Prefered path for Vulkan is /vendor/lib/hw
@@ -45,3 +72,33 @@ LOCAL_MODULE_RELATIVE_PATH := hw
 LOCAL_MODULE_TAGS := optional
 
 include $(BUILD_SHARED_LIBRARY)
+
+# Host build of the HAL for profiling it on desktop Linux, loaded by the
+# host benchmark in place of the device's hwvulkan module. It loads the
+# host's Mesa through the same driver probing and imports the dma-buf
+# buffers of the mock gralloc in host/. libsync and libhardware are device
+# only, vulkan_host_sync.cpp and vulkan_host_hardware.cpp stand in for them.
+# Built without VK_USE_PLATFORM_ANDROID_KHR: the HAL does not use the
+# Android surface types, and the headers they pull in are not on the host.
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := $(vulkan_hal_src_files) \
+	vulkan_host_hardware.cpp \
+	vulkan_host_sync.cpp
+LOCAL_CLANG := true
+LOCAL_CFLAGS := $(vulkan_hal_cflags)
+LOCAL_CPPFLAGS := $(vulkan_hal_cppflags)
+LOCAL_C_INCLUDES := $(vulkan_hal_c_includes) \
+	system/core/libsync/include
+
+LOCAL_SHARED_LIBRARIES := liblog libcutils
+LOCAL_LDLIBS := -ldl -lpthread
+LOCAL_REQUIRED_MODULES := gralloc.host
+
+LOCAL_MODULE := vulkan.host
+LOCAL_MODULE_HOST_OS := linux
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_SHARED_LIBRARY)
+
+include $(call all-makefiles-under,$(LOCAL_PATH))
@@ -0,0 +1,67 @@
+# Copyright (C) 2016 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+LOCAL_PATH := $(call my-dir)
+
+vulkan_hal_benchmark_src_files := \
+	vulkan_benchmark_gralloc.cpp \
+	vulkan_hal_benchmark.cpp
+# The HAL's warnings and log tag, the host build compiles the HAL's
+# stand-ins for libhardware and libsync in. The static registration
+# BENCHMARK expands to is a global constructor.
+vulkan_hal_benchmark_cflags := $(vulkan_hal_cflags) -Wno-global-constructors
+vulkan_hal_benchmark_cppflags := $(vulkan_hal_cppflags)
+
+# Microbenchmarks of the HAL loaded through hw_get_module, see
+# vulkan_hal_benchmark.cpp.
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := $(vulkan_hal_benchmark_src_files)
+LOCAL_CLANG := true
+LOCAL_CFLAGS := $(vulkan_hal_benchmark_cflags) -DVK_USE_PLATFORM_ANDROID_KHR
+LOCAL_CPPFLAGS := $(vulkan_hal_benchmark_cppflags)
+LOCAL_C_INCLUDES := frameworks/native/vulkan/include $(LOCAL_PATH)/..
+
+LOCAL_SHARED_LIBRARIES := libhardware libsync
+
+LOCAL_MODULE := vulkan_hal_benchmark
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_NATIVE_BENCHMARK)
+
+# The same benchmarks on desktop Linux, against vulkan.host and the mock
+# gralloc in host/, which the host hw_get_module loads from the library
+# path:
+#   LD_LIBRARY_PATH=$ANDROID_HOST_OUT/lib64 vulkan_hal_benchmark
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := $(vulkan_hal_benchmark_src_files) \
+	../vulkan_host_hardware.cpp \
+	../vulkan_host_sync.cpp
+LOCAL_CLANG := true
+LOCAL_CFLAGS := $(vulkan_hal_benchmark_cflags)
+LOCAL_CPPFLAGS := $(vulkan_hal_benchmark_cppflags)
+LOCAL_C_INCLUDES := frameworks/native/vulkan/include \
+	system/core/libsync/include \
+	$(LOCAL_PATH)/..
+
+LOCAL_SHARED_LIBRARIES := liblog libcutils
+LOCAL_LDLIBS := -ldl -lpthread
+LOCAL_REQUIRED_MODULES := vulkan.host gralloc.host
+
+LOCAL_MODULE := vulkan_hal_benchmark
+LOCAL_MODULE_HOST_OS := linux
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_NATIVE_BENCHMARK)
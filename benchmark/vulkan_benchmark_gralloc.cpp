@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <hardware/gralloc.h>
+#include <hardware/hardware.h>
+
+#include "vulkan_benchmark_platform.h"
+
+namespace vulkan_hal_benchmark {
+
+namespace {
+
+alloc_device_t* GetAllocDevice() {
+  static alloc_device_t* device = [] {
+    const hw_module_t* module;
+    alloc_device_t* allocDevice;
+    if (hw_get_module(GRALLOC_HARDWARE_MODULE_ID, &module) != 0 ||
+        gralloc_open(module, &allocDevice) != 0) {
+      fprintf(stderr, "failed to open gralloc\n");
+      return static_cast<alloc_device_t*>(nullptr);
+    }
+    return allocDevice;
+  }();
+  return device;
+}
+
+}  // namespace
+
+const hwvulkan_module_t* LoadHalModule() {
+  const hw_module_t* module;
+  if (hw_get_module(HWVULKAN_HARDWARE_MODULE_ID, &module) != 0)
+    return nullptr;
+  return reinterpret_cast<const hwvulkan_module_t*>(module);
+}
+
+bool AllocateBuffer(uint32_t width,
+                    uint32_t height,
+                    int format,
+                    int usage,
+                    Buffer* buffer) {
+  alloc_device_t* device = GetAllocDevice();
+  if (!device)
+    return false;
+  buffer_handle_t handle;
+  int stride;
+  if (device->alloc(device, static_cast<int>(width), static_cast<int>(height),
+                    format, usage, &handle, &stride) != 0)
+    return false;
+  buffer->handle = handle;
+  buffer->stride = stride;
+  return true;
+}
+
+void FreeBuffer(Buffer* buffer) {
+  alloc_device_t* device = GetAllocDevice();
+  device->free(device, buffer->handle);
+  buffer->handle = nullptr;
+}
+}
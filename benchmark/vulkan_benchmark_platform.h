@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_BENCHMARK_PLATFORM_H
+#define VULKAN_BENCHMARK_PLATFORM_H
+
+#include <stdint.h>
+#include <cutils/native_handle.h>
+#include <hardware/hwvulkan.h>
+
+namespace vulkan_hal_benchmark {
+
+// What the benchmark needs from the platform it runs on: the HAL module
+// under test and gralloc buffers to import. vulkan_benchmark_gralloc.cpp
+// gets both through hw_get_module, from libhardware on the device and from
+// vulkan_host_hardware.cpp on the host, where gralloc is the GBM mock.
+
+// Loads the Vulkan HAL module, NULL if there is none.
+const hwvulkan_module_t* LoadHalModule();
+
+struct Buffer {
+  const native_handle_t* handle;
+  // in pixels, as VkNativeBufferANDROID takes it
+  int stride;
+};
+
+// Allocates a buffer the way the platform does for a swapchain image, with
+// a HAL_PIXEL_FORMAT_* format and the gralloc usage the HAL asked for.
+bool AllocateBuffer(uint32_t width,
+                    uint32_t height,
+                    int format,
+                    int usage,
+                    Buffer* buffer);
+void FreeBuffer(Buffer* buffer);
+}
+
+#endif
@@ -0,0 +1,911 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Microbenchmarks of the HAL's hot paths, run against the HAL the platform
+// loads and the real driver behind it:
+//   vulkan_hal_benchmark --benchmark_filter=CreateImage
+// The OpenDevice benchmarks need the driver unloaded and so have to run
+// before every other one, which they do unless filtered out.
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include <hardware/gralloc.h>
+#include <hardware/hwvulkan.h>
+#include <sync/sync.h>
+#include <system/graphics.h>
+#include <vulkan/vk_android_native_buffer.h>
+
+#include "vulkan_benchmark_platform.h"
+#include "vulkan_hal_ext.h"
+
+namespace vulkan_hal_benchmark {
+
+namespace {
+
+const hwvulkan_module_t* GetHalModule() {
+  static const hwvulkan_module_t* module = LoadHalModule();
+  return module;
+}
+
+hwvulkan_device_t* OpenHal() {
+  const hwvulkan_module_t* module = GetHalModule();
+  hw_device_t* device;
+  if (!module ||
+      module->common.methods->open(&module->common, HWVULKAN_DEVICE_0,
+                                   &device) != 0)
+    return nullptr;
+  return reinterpret_cast<hwvulkan_device_t*>(device);
+}
+
+void CloseHal(hwvulkan_device_t* hal) {
+  hal->common.close(&hal->common);
+}
+
+// Extensions enabled where the driver has them, for the HAL's external
+// memory and sync_file paths to be the ones measured.
+const char* const kInstanceExtensions[] = {
+    "VK_KHR_get_physical_device_properties2",
+    "VK_KHR_external_memory_capabilities",
+    "VK_KHR_external_semaphore_capabilities",
+    "VK_KHR_external_fence_capabilities",
+};
+const char* const kDeviceExtensions[] = {
+    "VK_KHR_external_memory",
+    "VK_KHR_external_memory_fd",
+    "VK_EXT_external_memory_dma_buf",
+    "VK_KHR_image_format_list",
+    "VK_EXT_image_drm_format_modifier",
+    "VK_KHR_external_semaphore",
+    "VK_KHR_external_semaphore_fd",
+    "VK_KHR_external_fence",
+    "VK_KHR_external_fence_fd",
+};
+
+template <size_t N>
+std::vector<const char*> SelectExtensions(
+    const std::vector<VkExtensionProperties>& available,
+    const char* const (&wanted)[N]) {
+  std::vector<const char*> names;
+  for (const char* name : wanted) {
+    for (const VkExtensionProperties& extension : available) {
+      if (strcmp(extension.extensionName, name) == 0) {
+        names.push_back(name);
+        break;
+      }
+    }
+  }
+  return names;
+}
+
+// The instance and device every benchmark past the OpenDevice ones runs
+// on. Created on first use and kept until the process exits.
+struct Hal {
+  hwvulkan_device_t* hal;
+  VkInstance instance;
+  VkPhysicalDevice physicalDevice;
+  VkDevice device;
+  VkQueue queue;
+  PFN_vkGetDeviceProcAddr getDeviceProcAddr;
+  PFN_vkGetImageMemoryRequirements getImageMemoryRequirements;
+  PFN_vkCreateImage createImage;
+  PFN_vkDestroyImage destroyImage;
+  PFN_vkCreateSemaphore createSemaphore;
+  PFN_vkDestroySemaphore destroySemaphore;
+  PFN_vkGetSwapchainGrallocUsageANDROID getSwapchainGrallocUsage;
+  PFN_vkAcquireImageANDROID acquireImage;
+  PFN_vkQueueSignalReleaseImageANDROID queueSignalReleaseImage;
+  // the HAL's own entry points, see vulkan_hal_ext.h
+  PFN_vkHalPrepareNativeBuffers prepareNativeBuffers;
+  PFN_vkHalQueueNativeBufferFence queueNativeBufferFence;
+  PFN_vkHalAcquireQueuedImage acquireQueuedImage;
+};
+
+// set once the shared HAL is opened, which keeps the driver loaded
+bool sharedHalOpen = false;
+
+template <typename PFN>
+PFN GetInstanceProc(const Hal* hal, const char* name) {
+  return reinterpret_cast<PFN>(
+      hal->hal->GetInstanceProcAddr(hal->instance, name));
+}
+
+template <typename PFN>
+PFN GetDeviceProc(const Hal* hal, const char* name) {
+  return reinterpret_cast<PFN>(hal->getDeviceProcAddr(hal->device, name));
+}
+
+// With protectedMemory the device has a protected graphics queue, which
+// needs Vulkan 1.1 and the protectedMemory feature, and no queue is taken.
+bool CreateHalDevice(Hal* hal, bool protectedMemory) {
+  uint32_t count = 0;
+  hal->hal->EnumerateInstanceExtensionProperties(nullptr, &count, nullptr);
+  std::vector<VkExtensionProperties> instanceExtensions(count);
+  hal->hal->EnumerateInstanceExtensionProperties(nullptr, &count,
+                                                 instanceExtensions.data());
+  instanceExtensions.resize(count);
+  std::vector<const char*> instanceNames =
+      SelectExtensions(instanceExtensions, kInstanceExtensions);
+
+  const VkApplicationInfo appInfo = {
+      .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+      .pNext = nullptr,
+      .pApplicationName = "vulkan_hal_benchmark",
+      .applicationVersion = 0,
+      .pEngineName = nullptr,
+      .engineVersion = 0,
+      .apiVersion = protectedMemory ? VK_API_VERSION_1_1 : VK_API_VERSION_1_0,
+  };
+  const VkInstanceCreateInfo instanceInfo = {
+      .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+      .pNext = nullptr,
+      .flags = 0,
+      .pApplicationInfo = &appInfo,
+      .enabledLayerCount = 0,
+      .ppEnabledLayerNames = nullptr,
+      .enabledExtensionCount = static_cast<uint32_t>(instanceNames.size()),
+      .ppEnabledExtensionNames = instanceNames.data(),
+  };
+  if (hal->hal->CreateInstance(&instanceInfo, nullptr, &hal->instance) !=
+      VK_SUCCESS)
+    return false;
+
+  uint32_t physicalDeviceCount = 1;
+  VkResult result = GetInstanceProc<PFN_vkEnumeratePhysicalDevices>(
+      hal, "vkEnumeratePhysicalDevices")(hal->instance, &physicalDeviceCount,
+                                         &hal->physicalDevice);
+  if ((result != VK_SUCCESS && result != VK_INCOMPLETE) ||
+      physicalDeviceCount == 0)
+    return false;
+
+  PFN_vkGetPhysicalDeviceQueueFamilyProperties getQueueFamilyProperties =
+      GetInstanceProc<PFN_vkGetPhysicalDeviceQueueFamilyProperties>(
+          hal, "vkGetPhysicalDeviceQueueFamilyProperties");
+  getQueueFamilyProperties(hal->physicalDevice, &count, nullptr);
+  std::vector<VkQueueFamilyProperties> families(count);
+  getQueueFamilyProperties(hal->physicalDevice, &count, families.data());
+  uint32_t family = 0;
+  while (family < count &&
+         !(families[family].queueFlags & VK_QUEUE_GRAPHICS_BIT))
+    family++;
+  if (family == count)
+    return false;
+
+  VkPhysicalDeviceProtectedMemoryFeatures protectedFeatures = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROTECTED_MEMORY_FEATURES,
+      .pNext = nullptr,
+      .protectedMemory = VK_FALSE,
+  };
+  if (protectedMemory) {
+    PFN_vkGetPhysicalDeviceFeatures2 getFeatures2 =
+        GetInstanceProc<PFN_vkGetPhysicalDeviceFeatures2>(
+            hal, "vkGetPhysicalDeviceFeatures2");
+    if (!getFeatures2 ||
+        !(families[family].queueFlags & VK_QUEUE_PROTECTED_BIT))
+      return false;
+    VkPhysicalDeviceFeatures2 features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+        .pNext = &protectedFeatures,
+        .features = {},
+    };
+    getFeatures2(hal->physicalDevice, &features);
+    if (!protectedFeatures.protectedMemory)
+      return false;
+  }
+
+  PFN_vkEnumerateDeviceExtensionProperties enumerateDeviceExtensions =
+      GetInstanceProc<PFN_vkEnumerateDeviceExtensionProperties>(
+          hal, "vkEnumerateDeviceExtensionProperties");
+  count = 0;
+  enumerateDeviceExtensions(hal->physicalDevice, nullptr, &count, nullptr);
+  std::vector<VkExtensionProperties> deviceExtensions(count);
+  enumerateDeviceExtensions(hal->physicalDevice, nullptr, &count,
+                            deviceExtensions.data());
+  deviceExtensions.resize(count);
+  std::vector<const char*> deviceNames =
+      SelectExtensions(deviceExtensions, kDeviceExtensions);
+
+  const float priority = 1.0f;
+  const VkDeviceQueueCreateInfo queueInfo = {
+      .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+      .pNext = nullptr,
+      .flags = protectedMemory
+                   ? static_cast<VkDeviceQueueCreateFlags>(
+                         VK_DEVICE_QUEUE_CREATE_PROTECTED_BIT)
+                   : 0,
+      .queueFamilyIndex = family,
+      .queueCount = 1,
+      .pQueuePriorities = &priority,
+  };
+  const VkDeviceCreateInfo deviceInfo = {
+      .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+      .pNext = protectedMemory ? &protectedFeatures : nullptr,
+      .flags = 0,
+      .queueCreateInfoCount = 1,
+      .pQueueCreateInfos = &queueInfo,
+      .enabledLayerCount = 0,
+      .ppEnabledLayerNames = nullptr,
+      .enabledExtensionCount = static_cast<uint32_t>(deviceNames.size()),
+      .ppEnabledExtensionNames = deviceNames.data(),
+      .pEnabledFeatures = nullptr,
+  };
+  if (GetInstanceProc<PFN_vkCreateDevice>(hal, "vkCreateDevice")(
+          hal->physicalDevice, &deviceInfo, nullptr, &hal->device) !=
+      VK_SUCCESS)
+    return false;
+
+  hal->getDeviceProcAddr =
+      GetInstanceProc<PFN_vkGetDeviceProcAddr>(hal, "vkGetDeviceProcAddr");
+  // a protected queue could only be taken with vkGetDeviceQueue2
+  hal->queue = VK_NULL_HANDLE;
+  if (!protectedMemory)
+    GetDeviceProc<PFN_vkGetDeviceQueue>(hal, "vkGetDeviceQueue")(
+        hal->device, family, 0, &hal->queue);
+  hal->getImageMemoryRequirements =
+      GetDeviceProc<PFN_vkGetImageMemoryRequirements>(
+          hal, "vkGetImageMemoryRequirements");
+  hal->createImage = GetDeviceProc<PFN_vkCreateImage>(hal, "vkCreateImage");
+  hal->destroyImage = GetDeviceProc<PFN_vkDestroyImage>(hal, "vkDestroyImage");
+  hal->createSemaphore =
+      GetDeviceProc<PFN_vkCreateSemaphore>(hal, "vkCreateSemaphore");
+  hal->destroySemaphore =
+      GetDeviceProc<PFN_vkDestroySemaphore>(hal, "vkDestroySemaphore");
+  hal->getSwapchainGrallocUsage =
+      GetDeviceProc<PFN_vkGetSwapchainGrallocUsageANDROID>(
+          hal, "vkGetSwapchainGrallocUsageANDROID");
+  hal->acquireImage =
+      GetDeviceProc<PFN_vkAcquireImageANDROID>(hal, "vkAcquireImageANDROID");
+  hal->queueSignalReleaseImage =
+      GetDeviceProc<PFN_vkQueueSignalReleaseImageANDROID>(
+          hal, "vkQueueSignalReleaseImageANDROID");
+  hal->prepareNativeBuffers = GetDeviceProc<PFN_vkHalPrepareNativeBuffers>(
+      hal, "vkHalPrepareNativeBuffers");
+  hal->queueNativeBufferFence =
+      GetDeviceProc<PFN_vkHalQueueNativeBufferFence>(
+          hal, "vkHalQueueNativeBufferFence");
+  hal->acquireQueuedImage = GetDeviceProc<PFN_vkHalAcquireQueuedImage>(
+      hal, "vkHalAcquireQueuedImage");
+  return true;
+}
+
+const Hal* GetHal() {
+  static const Hal* shared = [] {
+    Hal* hal = new Hal();
+    hal->hal = OpenHal();
+    sharedHalOpen = hal->hal != nullptr;
+    if (!hal->hal || !CreateHalDevice(hal, false)) {
+      fprintf(stderr, "failed to create a device through the HAL\n");
+      return static_cast<const Hal*>(nullptr);
+    }
+    return static_cast<const Hal*>(hal);
+  }();
+  return shared;
+}
+
+// A second device with a protected queue, NULL where the driver has no
+// protected memory.
+const Hal* GetProtectedHal() {
+  static const Hal* shared = [] {
+    if (!GetHal())
+      return static_cast<const Hal*>(nullptr);
+    Hal* hal = new Hal();
+    hal->hal = OpenHal();
+    if (!hal->hal || !CreateHalDevice(hal, true))
+      return static_cast<const Hal*>(nullptr);
+    return static_cast<const Hal*>(hal);
+  }();
+  return shared;
+}
+
+// A gralloc buffer and its swapchain image on the shared device.
+struct SwapchainImage {
+  Buffer buffer;
+  // gralloc usage of buffer
+  int usage;
+  VkImage image;
+};
+
+const VkImageUsageFlags kSwapchainImageUsage =
+    VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+
+// Allocates the buffer, with the HAL's usage on top of SurfaceFlinger's.
+bool AllocateSwapchainBuffer(const Hal* hal,
+                             VkFormat format,
+                             int halFormat,
+                             const VkExtent2D& extent,
+                             SwapchainImage* swapchainImage) {
+  int usage = 0;
+  if (hal->getSwapchainGrallocUsage(hal->device, format, kSwapchainImageUsage,
+                                    &usage) != VK_SUCCESS)
+    return false;
+  usage |= GRALLOC_USAGE_HW_COMPOSER | GRALLOC_USAGE_HW_TEXTURE;
+  swapchainImage->usage = usage;
+  swapchainImage->image = VK_NULL_HANDLE;
+  return AllocateBuffer(extent.width, extent.height, halFormat, usage,
+                        &swapchainImage->buffer);
+}
+
+VkNativeBufferANDROID GetNativeBuffer(int halFormat,
+                                      const SwapchainImage& swapchainImage) {
+  return {
+      .sType = VK_STRUCTURE_TYPE_NATIVE_BUFFER_ANDROID,
+      .pNext = nullptr,
+      .handle = swapchainImage.buffer.handle,
+      .stride = swapchainImage.buffer.stride,
+      .format = halFormat,
+      .usage = swapchainImage.usage,
+  };
+}
+
+// The create info of a swapchain image, pNext is the native buffer for
+// vkCreateImage and NULL for vkHalPrepareNativeBuffers.
+VkImageCreateInfo GetSwapchainImageInfo(VkFormat format,
+                                        const VkExtent2D& extent,
+                                        const void* pNext) {
+  return {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+      .pNext = pNext,
+      .flags = 0,
+      .imageType = VK_IMAGE_TYPE_2D,
+      .format = format,
+      .extent = {extent.width, extent.height, 1},
+      .mipLevels = 1,
+      .arrayLayers = 1,
+      .samples = VK_SAMPLE_COUNT_1_BIT,
+      .tiling = VK_IMAGE_TILING_OPTIMAL,
+      .usage = kSwapchainImageUsage,
+      .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+      .queueFamilyIndexCount = 0,
+      .pQueueFamilyIndices = nullptr,
+      .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+  };
+}
+
+// Imports the buffer the way the platform creates swapchain images.
+VkResult CreateSwapchainImage(const Hal* hal,
+                              VkFormat format,
+                              int halFormat,
+                              const VkExtent2D& extent,
+                              SwapchainImage* swapchainImage) {
+  const VkNativeBufferANDROID nativeBuffer =
+      GetNativeBuffer(halFormat, *swapchainImage);
+  const VkImageCreateInfo imageInfo =
+      GetSwapchainImageInfo(format, extent, &nativeBuffer);
+  return hal->createImage(hal->device, &imageInfo, nullptr,
+                          &swapchainImage->image);
+}
+
+void DestroySwapchainImage(const Hal* hal, SwapchainImage* swapchainImage) {
+  hal->destroyImage(hal->device, swapchainImage->image, nullptr);
+  swapchainImage->image = VK_NULL_HANDLE;
+}
+
+// Opening the HAL and loading the driver on first use, as an app's first
+// Vulkan call does. Every close unloads the driver again.
+void BM_OpenDeviceCold(benchmark::State& state) {
+  if (sharedHalOpen) {
+    state.SkipWithError("the driver is loaded already, run this one first");
+    return;
+  }
+  while (state.KeepRunning()) {
+    hwvulkan_device_t* hal = OpenHal();
+    if (!hal) {
+      state.SkipWithError("failed to open the HAL");
+      return;
+    }
+    PFN_vkVoidFunction proc =
+        hal->GetInstanceProcAddr(VK_NULL_HANDLE, "vkCreateInstance");
+    CloseHal(hal);
+    if (!proc) {
+      state.SkipWithError("failed to load the driver");
+      return;
+    }
+  }
+}
+BENCHMARK(BM_OpenDeviceCold)->Unit(benchmark::kMicrosecond);
+
+// The same with another open device holding the driver loaded.
+void BM_OpenDeviceWarm(benchmark::State& state) {
+  hwvulkan_device_t* holder = OpenHal();
+  if (!holder ||
+      !holder->GetInstanceProcAddr(VK_NULL_HANDLE, "vkCreateInstance")) {
+    state.SkipWithError("failed to load the driver");
+    if (holder)
+      CloseHal(holder);
+    return;
+  }
+  while (state.KeepRunning()) {
+    hwvulkan_device_t* hal = OpenHal();
+    benchmark::DoNotOptimize(
+        hal->GetInstanceProcAddr(VK_NULL_HANDLE, "vkCreateInstance"));
+    CloseHal(hal);
+  }
+  CloseHal(holder);
+}
+BENCHMARK(BM_OpenDeviceWarm);
+
+// What the platform does to probe for Vulkan, served from the extension
+// snapshot without loading the driver when there is one.
+void BM_EnumerateInstanceExtensionsCold(benchmark::State& state) {
+  if (sharedHalOpen) {
+    state.SkipWithError("the driver is loaded already, run this one first");
+    return;
+  }
+  while (state.KeepRunning()) {
+    hwvulkan_device_t* hal = OpenHal();
+    if (!hal) {
+      state.SkipWithError("failed to open the HAL");
+      return;
+    }
+    uint32_t count = 0;
+    VkResult result =
+        hal->EnumerateInstanceExtensionProperties(nullptr, &count, nullptr);
+    CloseHal(hal);
+    if (result != VK_SUCCESS) {
+      state.SkipWithError("failed to enumerate instance extensions");
+      return;
+    }
+  }
+}
+BENCHMARK(BM_EnumerateInstanceExtensionsCold)->Unit(benchmark::kMicrosecond);
+
+// a hook, a wrapped driver entry point and a plain driver one
+const char* const kInstanceProcNames[] = {
+    "vkCreateDevice",
+    "vkGetPhysicalDeviceProperties2KHR",
+    "vkEnumeratePhysicalDevices",
+};
+
+void BM_GetInstanceProcAddr(benchmark::State& state) {
+  const Hal* hal = GetHal();
+  if (!hal) {
+    state.SkipWithError("no device");
+    return;
+  }
+  const char* name = kInstanceProcNames[state.range(0)];
+  while (state.KeepRunning())
+    benchmark::DoNotOptimize(
+        hal->hal->GetInstanceProcAddr(hal->instance, name));
+  state.SetItemsProcessed(state.iterations());
+  state.SetLabel(name);
+}
+BENCHMARK(BM_GetInstanceProcAddr)
+    ->DenseRange(
+        0, static_cast<int>(sizeof(kInstanceProcNames) / sizeof(char*)) - 1);
+
+// a hook, a fallback the driver may implement itself, one hooked with the
+// deferred acquire strategy only and a plain driver entry point
+const char* const kDeviceProcNames[] = {
+    "vkCreateImage",
+    "vkAcquireImageANDROID",
+    "vkQueueSubmit",
+    "vkCmdDraw",
+};
+
+void BM_GetDeviceProcAddr(benchmark::State& state) {
+  const Hal* hal = GetHal();
+  if (!hal) {
+    state.SkipWithError("no device");
+    return;
+  }
+  const char* name = kDeviceProcNames[state.range(0)];
+  while (state.KeepRunning())
+    benchmark::DoNotOptimize(hal->getDeviceProcAddr(hal->device, name));
+  state.SetItemsProcessed(state.iterations());
+  state.SetLabel(name);
+}
+BENCHMARK(BM_GetDeviceProcAddr)
+    ->DenseRange(
+        0, static_cast<int>(sizeof(kDeviceProcNames) / sizeof(char*)) - 1);
+
+struct ImportFormat {
+  const char* name;
+  VkFormat format;
+  int halFormat;
+};
+
+const ImportFormat kImportFormats[] = {
+    {"RGBA_8888", VK_FORMAT_R8G8B8A8_UNORM, HAL_PIXEL_FORMAT_RGBA_8888},
+    {"RGB_565", VK_FORMAT_R5G6B5_UNORM_PACK16, HAL_PIXEL_FORMAT_RGB_565},
+    {"RGBA_FP16", VK_FORMAT_R16G16B16A16_SFLOAT, HAL_PIXEL_FORMAT_RGBA_FP16},
+};
+
+const VkExtent2D kImportExtents[] = {
+    {1280, 720},
+    {1920, 1080},
+    {3840, 2160},
+};
+
+void ImportArgs(benchmark::internal::Benchmark* benchmark) {
+  for (int64_t format = 0;
+       format < static_cast<int64_t>(sizeof(kImportFormats) /
+                                     sizeof(kImportFormats[0]));
+       format++) {
+    for (int64_t extent = 0;
+         extent < static_cast<int64_t>(sizeof(kImportExtents) /
+                                       sizeof(kImportExtents[0]));
+         extent++)
+      benchmark->Args({format, extent});
+  }
+}
+
+void SetImportLabel(benchmark::State& state,
+                    const ImportFormat& format,
+                    const VkExtent2D& extent) {
+  state.SetLabel(std::string(format.name) + " " +
+                 std::to_string(extent.width) + "x" +
+                 std::to_string(extent.height));
+}
+
+// vkCreateImage of a buffer the HAL has not seen before, as when a
+// swapchain is created. The buffer is allocated and the image destroyed
+// outside of the timing.
+void BM_CreateImageImport(benchmark::State& state) {
+  const Hal* hal = GetHal();
+  if (!hal) {
+    state.SkipWithError("no device");
+    return;
+  }
+  const ImportFormat& format = kImportFormats[state.range(0)];
+  const VkExtent2D& extent = kImportExtents[state.range(1)];
+  SwapchainImage swapchainImage;
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    if (!AllocateSwapchainBuffer(hal, format.format, format.halFormat, extent,
+                                 &swapchainImage)) {
+      state.SkipWithError("failed to allocate the buffer");
+      return;
+    }
+    state.ResumeTiming();
+
+    VkResult result = CreateSwapchainImage(hal, format.format,
+                                           format.halFormat, extent,
+                                           &swapchainImage);
+
+    state.PauseTiming();
+    if (result == VK_SUCCESS)
+      DestroySwapchainImage(hal, &swapchainImage);
+    FreeBuffer(&swapchainImage.buffer);
+    if (result != VK_SUCCESS) {
+      state.SkipWithError("failed to import the buffer");
+      return;
+    }
+    state.ResumeTiming();
+  }
+  SetImportLabel(state, format, extent);
+}
+BENCHMARK(BM_CreateImageImport)
+    ->Apply(ImportArgs)
+    ->Unit(benchmark::kMicrosecond);
+
+// vkCreateImage and vkDestroyImage of the same buffer over and over, as
+// when a swapchain is recreated with the buffers of the old one and the
+// imports come out of the HAL's cache.
+void BM_CreateImageCached(benchmark::State& state) {
+  const Hal* hal = GetHal();
+  if (!hal) {
+    state.SkipWithError("no device");
+    return;
+  }
+  const ImportFormat& format = kImportFormats[state.range(0)];
+  const VkExtent2D& extent = kImportExtents[state.range(1)];
+  SwapchainImage swapchainImage;
+  if (!AllocateSwapchainBuffer(hal, format.format, format.halFormat, extent,
+                               &swapchainImage)) {
+    state.SkipWithError("failed to allocate the buffer");
+    return;
+  }
+  while (state.KeepRunning()) {
+    if (CreateSwapchainImage(hal, format.format, format.halFormat, extent,
+                             &swapchainImage) != VK_SUCCESS) {
+      state.SkipWithError("failed to import the buffer");
+      break;
+    }
+    DestroySwapchainImage(hal, &swapchainImage);
+  }
+  FreeBuffer(&swapchainImage.buffer);
+  SetImportLabel(state, format, extent);
+}
+BENCHMARK(BM_CreateImageCached)->Apply(ImportArgs);
+
+// vkCreateImage of a protected NV12 buffer, as the video decoder hands
+// out for DRM content, on the device with a protected queue. Fails unless
+// the import lands in protected memory: the image may only be bound to a
+// memory type its requirements allow, so those must all be protected.
+void BM_CreateImageProtectedNV12(benchmark::State& state) {
+  const Hal* hal = GetProtectedHal();
+  if (!hal) {
+    state.SkipWithError("no device with protected memory");
+    return;
+  }
+  VkPhysicalDeviceMemoryProperties memoryProperties;
+  GetInstanceProc<PFN_vkGetPhysicalDeviceMemoryProperties>(
+      hal, "vkGetPhysicalDeviceMemoryProperties")(hal->physicalDevice,
+                                                  &memoryProperties);
+  uint32_t protectedTypeBits = 0;
+  for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+    if (memoryProperties.memoryTypes[i].propertyFlags &
+        VK_MEMORY_PROPERTY_PROTECTED_BIT)
+      protectedTypeBits |= 1u << i;
+  }
+
+  const VkFormat format = VK_FORMAT_G8_B8R8_2PLANE_420_UNORM;
+  const int halFormat = HAL_PIXEL_FORMAT_YCbCr_420_888;
+  const int usage = GRALLOC_USAGE_PROTECTED | GRALLOC_USAGE_HW_TEXTURE;
+  const VkExtent2D& extent = kImportExtents[1];
+  Buffer buffer;
+  if (!AllocateBuffer(extent.width, extent.height, halFormat, usage,
+                      &buffer)) {
+    state.SkipWithError("failed to allocate a protected buffer");
+    return;
+  }
+  const VkNativeBufferANDROID nativeBuffer = {
+      .sType = VK_STRUCTURE_TYPE_NATIVE_BUFFER_ANDROID,
+      .pNext = nullptr,
+      .handle = buffer.handle,
+      .stride = buffer.stride,
+      .format = halFormat,
+      .usage = usage,
+  };
+  const VkImageCreateInfo imageInfo = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+      .pNext = &nativeBuffer,
+      .flags = VK_IMAGE_CREATE_PROTECTED_BIT,
+      .imageType = VK_IMAGE_TYPE_2D,
+      .format = format,
+      .extent = {extent.width, extent.height, 1},
+      .mipLevels = 1,
+      .arrayLayers = 1,
+      .samples = VK_SAMPLE_COUNT_1_BIT,
+      .tiling = VK_IMAGE_TILING_OPTIMAL,
+      .usage = VK_IMAGE_USAGE_SAMPLED_BIT,
+      .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+      .queueFamilyIndexCount = 0,
+      .pQueueFamilyIndices = nullptr,
+      .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+  };
+  while (state.KeepRunning()) {
+    VkImage image;
+    if (hal->createImage(hal->device, &imageInfo, nullptr, &image) !=
+        VK_SUCCESS) {
+      state.SkipWithError("failed to import the protected buffer");
+      break;
+    }
+    state.PauseTiming();
+    VkMemoryRequirements requirements;
+    hal->getImageMemoryRequirements(hal->device, image, &requirements);
+    hal->destroyImage(hal->device, image, nullptr);
+    if (!requirements.memoryTypeBits ||
+        (requirements.memoryTypeBits & ~protectedTypeBits)) {
+      state.SkipWithError("protected import outside of protected memory");
+      break;
+    }
+    state.ResumeTiming();
+  }
+  FreeBuffer(&buffer);
+  SetImportLabel(state, {"NV12", format, halFormat}, extent);
+}
+BENCHMARK(BM_CreateImageProtectedNV12)->Unit(benchmark::kMicrosecond);
+
+// vkAcquireImageANDROID into a semaphore and vkQueueSignalReleaseImageANDROID
+// waiting on it, until the release fence signals. The acquire fence is
+// either the -1 of a buffer that is ready or the release fence of the
+// previous round, as when the compositor hands the buffer straight back.
+void BM_AcquireReleaseFence(benchmark::State& state) {
+  const Hal* hal = GetHal();
+  if (!hal) {
+    state.SkipWithError("no device");
+    return;
+  }
+  const ImportFormat& format = kImportFormats[0];
+  const VkExtent2D& extent = kImportExtents[1];
+  SwapchainImage swapchainImage;
+  if (!AllocateSwapchainBuffer(hal, format.format, format.halFormat, extent,
+                               &swapchainImage)) {
+    state.SkipWithError("failed to allocate the buffer");
+    return;
+  }
+  if (CreateSwapchainImage(hal, format.format, format.halFormat, extent,
+                           &swapchainImage) != VK_SUCCESS) {
+    FreeBuffer(&swapchainImage.buffer);
+    state.SkipWithError("failed to import the buffer");
+    return;
+  }
+  const VkSemaphoreCreateInfo semaphoreInfo = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+      .pNext = nullptr,
+      .flags = 0,
+  };
+  VkSemaphore semaphore;
+  if (hal->createSemaphore(hal->device, &semaphoreInfo, nullptr,
+                           &semaphore) != VK_SUCCESS) {
+    DestroySwapchainImage(hal, &swapchainImage);
+    FreeBuffer(&swapchainImage.buffer);
+    state.SkipWithError("failed to create a semaphore");
+    return;
+  }
+
+  const bool chained = state.range(0) != 0;
+  int fence = -1;
+  while (state.KeepRunning()) {
+    // the HAL owns the acquire fence from here on
+    VkResult result = hal->acquireImage(hal->device, swapchainImage.image,
+                                        fence, semaphore, VK_NULL_HANDLE);
+    fence = -1;
+    if (result == VK_SUCCESS)
+      result = hal->queueSignalReleaseImage(hal->queue, 1, &semaphore,
+                                            swapchainImage.image, &fence);
+    if (result != VK_SUCCESS) {
+      state.SkipWithError("failed to acquire and release the image");
+      break;
+    }
+    if (fence >= 0)
+      sync_wait(fence, -1);
+    if (!chained && fence >= 0) {
+      close(fence);
+      fence = -1;
+    }
+  }
+  if (fence >= 0)
+    close(fence);
+
+  hal->destroySemaphore(hal->device, semaphore, nullptr);
+  DestroySwapchainImage(hal, &swapchainImage);
+  FreeBuffer(&swapchainImage.buffer);
+  state.SetLabel(chained ? "chained" : "ready");
+}
+BENCHMARK(BM_AcquireReleaseFence)->Arg(0)->Arg(1);
+
+// vkHalPrepareNativeBuffers of a new triple buffered swapchain followed by
+// the vkCreateImage calls claiming the pre-imports, to compare with three
+// rounds of CreateImageImport. The buffers are allocated and the images
+// destroyed outside of the timing.
+void BM_PrepareNativeBuffers(benchmark::State& state) {
+  const Hal* hal = GetHal();
+  if (!hal) {
+    state.SkipWithError("no device");
+    return;
+  }
+  if (!hal->prepareNativeBuffers) {
+    state.SkipWithError("no vkHalPrepareNativeBuffers");
+    return;
+  }
+  const ImportFormat& format = kImportFormats[0];
+  const VkExtent2D& extent = kImportExtents[state.range(0)];
+  const VkImageCreateInfo imageInfo =
+      GetSwapchainImageInfo(format.format, extent, nullptr);
+  SwapchainImage swapchainImages[3];
+  VkNativeBufferANDROID nativeBuffers[3];
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    for (uint32_t i = 0; i < 3; i++) {
+      if (!AllocateSwapchainBuffer(hal, format.format, format.halFormat,
+                                   extent, &swapchainImages[i])) {
+        state.SkipWithError("failed to allocate the buffers");
+        return;
+      }
+      nativeBuffers[i] = GetNativeBuffer(format.halFormat, swapchainImages[i]);
+    }
+    state.ResumeTiming();
+
+    VkResult result = hal->prepareNativeBuffers(hal->device, &imageInfo, 3,
+                                                nativeBuffers, VK_FALSE);
+    for (uint32_t i = 0; i < 3 && result == VK_SUCCESS; i++)
+      result = CreateSwapchainImage(hal, format.format, format.halFormat,
+                                    extent, &swapchainImages[i]);
+
+    state.PauseTiming();
+    for (SwapchainImage& swapchainImage : swapchainImages) {
+      if (swapchainImage.image != VK_NULL_HANDLE)
+        DestroySwapchainImage(hal, &swapchainImage);
+      FreeBuffer(&swapchainImage.buffer);
+    }
+    if (result != VK_SUCCESS) {
+      state.SkipWithError("failed to import the buffers");
+      return;
+    }
+    state.ResumeTiming();
+  }
+  SetImportLabel(state, format, extent);
+}
+BENCHMARK(BM_PrepareNativeBuffers)
+    ->DenseRange(
+        0, static_cast<int>(sizeof(kImportExtents) / sizeof(VkExtent2D)) - 1)
+    ->Unit(benchmark::kMicrosecond);
+
+// vkHalAcquireQueuedImage and vkQueueSignalReleaseImageANDROID on a double
+// buffered swapchain whose release fences go straight back as the acquire
+// fences queued with vkHalQueueNativeBufferFence, as when the compositor
+// returns each buffer as soon as the GPU is done with it.
+void BM_AcquireQueuedImage(benchmark::State& state) {
+  const Hal* hal = GetHal();
+  if (!hal) {
+    state.SkipWithError("no device");
+    return;
+  }
+  if (!hal->queueNativeBufferFence || !hal->acquireQueuedImage) {
+    state.SkipWithError("no queued acquire");
+    return;
+  }
+  const ImportFormat& format = kImportFormats[0];
+  const VkExtent2D& extent = kImportExtents[1];
+  SwapchainImage swapchainImages[2];
+  VkImage images[2];
+  uint32_t imported = 0;
+  for (; imported < 2; imported++) {
+    SwapchainImage& swapchainImage = swapchainImages[imported];
+    if (!AllocateSwapchainBuffer(hal, format.format, format.halFormat, extent,
+                                 &swapchainImage))
+      break;
+    if (CreateSwapchainImage(hal, format.format, format.halFormat, extent,
+                             &swapchainImage) != VK_SUCCESS) {
+      FreeBuffer(&swapchainImage.buffer);
+      break;
+    }
+    images[imported] = swapchainImage.image;
+  }
+  const VkSemaphoreCreateInfo semaphoreInfo = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+      .pNext = nullptr,
+      .flags = 0,
+  };
+  VkSemaphore semaphore = VK_NULL_HANDLE;
+  if (imported < 2 ||
+      hal->createSemaphore(hal->device, &semaphoreInfo, nullptr,
+                           &semaphore) != VK_SUCCESS) {
+    for (uint32_t i = 0; i < imported; i++) {
+      DestroySwapchainImage(hal, &swapchainImages[i]);
+      FreeBuffer(&swapchainImages[i].buffer);
+    }
+    state.SkipWithError("failed to set up the swapchain");
+    return;
+  }
+
+  // both buffers start out ready
+  for (VkImage image : images)
+    hal->queueNativeBufferFence(hal->device, image, -1);
+  while (state.KeepRunning()) {
+    uint32_t index;
+    VkResult result =
+        hal->acquireQueuedImage(hal->device, 2, images, UINT64_MAX,
+                                semaphore, VK_NULL_HANDLE, &index);
+    int fence = -1;
+    if (result == VK_SUCCESS)
+      result = hal->queueSignalReleaseImage(hal->queue, 1, &semaphore,
+                                            images[index], &fence);
+    if (result != VK_SUCCESS) {
+      state.SkipWithError("failed to acquire and release an image");
+      break;
+    }
+    // the HAL owns the fence from here on
+    hal->queueNativeBufferFence(hal->device, images[index], fence);
+  }
+
+  hal->destroySemaphore(hal->device, semaphore, nullptr);
+  for (SwapchainImage& swapchainImage : swapchainImages) {
+    DestroySwapchainImage(hal, &swapchainImage);
+    FreeBuffer(&swapchainImage.buffer);
+  }
+}
+BENCHMARK(BM_AcquireQueuedImage);
+
+}  // namespace
+}
+
+BENCHMARK_MAIN();
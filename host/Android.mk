@@ -0,0 +1,35 @@
+# Copyright (C) 2016 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+
+LOCAL_PATH := $(call my-dir)
+
+# GBM backed mock gralloc for the host build of the HAL, see
+# vulkan_host_gralloc.cpp. Needs the host's libgbm from Mesa.
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := vulkan_host_gralloc.cpp
+LOCAL_CLANG := true
+LOCAL_CFLAGS := $(filter-out -DLOG_TAG=%,$(vulkan_hal_cflags)) \
+	-DLOG_TAG=\"VulkanHostGralloc\"
+LOCAL_CPPFLAGS := $(vulkan_hal_cppflags)
+
+LOCAL_SHARED_LIBRARIES := liblog libcutils
+LOCAL_LDLIBS := -lgbm -lpthread
+
+LOCAL_MODULE := gralloc.host
+LOCAL_MODULE_HOST_OS := linux
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_SHARED_LIBRARY)
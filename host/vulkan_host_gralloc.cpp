@@ -0,0 +1,376 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Mock gralloc for host builds of the HAL, loaded as gralloc.host.so by
+// the host hw_get_module.
+//
+// Buffers are GBM buffer objects on the first Intel render node, handed out
+// as their dma-buf the way the device gralloc does: data[0] of the native
+// handle is the dma-buf, followed by the ints below. Buffers the HAL
+// imports through vkCreateDmaBufImageINTEL are allocated X tiled, which is
+// what it assumes when gralloc does not take modifiers. YUV buffers are
+// linear, planes one after the other in a single R8 buffer tall enough for
+// all of them. The handles are plain fds, so registering them is a no-op.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <gbm.h>
+#include <cutils/log.h>
+#include <cutils/native_handle.h>
+#include <hardware/gralloc.h>
+#include <system/graphics.h>
+
+namespace {
+
+// as in vulkan_modifier.h, drm_fourcc.h is not on every host
+const uint64_t kI915FormatModXTiled = (1ull << 56) | 1;
+
+#ifndef GBM_FORMAT_ABGR16161616F
+#define GBM_FORMAT_ABGR16161616F __gbm_fourcc_code('A', 'B', '4', 'H')
+#endif
+
+const unsigned long kIntelVendorId = 0x8086;
+const uint32_t kFirstRenderNode = 128;
+const uint32_t kRenderNodeCount = 64;
+
+// ints of a buffer's native handle, after its dma-buf
+enum HandleInt {
+  kHandleMagic,
+  kHandleWidth,
+  kHandleHeight,
+  kHandleFormat,
+  kHandleByteStride,
+  kHandleIntCount,
+};
+
+const int kHandleMagicValue = 0x67626d31;  // "gbm1"
+
+struct FormatInfo {
+  int halFormat;
+  uint32_t gbmFormat;
+  int bytesPerPixel;
+  bool yuv;
+};
+
+const FormatInfo kFormats[] = {
+    {HAL_PIXEL_FORMAT_RGBA_8888, GBM_FORMAT_ABGR8888, 4, false},
+    {HAL_PIXEL_FORMAT_RGBX_8888, GBM_FORMAT_XBGR8888, 4, false},
+    {HAL_PIXEL_FORMAT_BGRA_8888, GBM_FORMAT_ARGB8888, 4, false},
+    {HAL_PIXEL_FORMAT_RGB_565, GBM_FORMAT_RGB565, 2, false},
+    {HAL_PIXEL_FORMAT_RGBA_1010102, GBM_FORMAT_ABGR2101010, 4, false},
+    {HAL_PIXEL_FORMAT_RGBA_FP16, GBM_FORMAT_ABGR16161616F, 8, false},
+    // NV12: the luma plane, then interleaved Cb and Cr
+    {HAL_PIXEL_FORMAT_YCbCr_420_888, GBM_FORMAT_R8, 1, true},
+    // the luma plane, then Cr and Cb at half the luma stride
+    {HAL_PIXEL_FORMAT_YV12, GBM_FORMAT_R8, 1, true},
+};
+
+const FormatInfo* FindFormat(int halFormat) {
+  for (const FormatInfo& info : kFormats) {
+    if (info.halFormat == halFormat)
+      return &info;
+  }
+  return nullptr;
+}
+
+pthread_once_t gbmOnce = PTHREAD_ONCE_INIT;
+gbm_device* gbmDevice = nullptr;
+
+// The render node the HAL's driver probing picks, the first Intel one.
+void OpenGbmDevice() {
+  for (uint32_t i = 0; i < kRenderNodeCount; i++) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/class/drm/renderD%u/device/vendor",
+             kFirstRenderNode + i);
+    FILE* file = fopen(path, "re");
+    if (!file)
+      continue;
+    unsigned long vendor = 0;
+    const bool read = fscanf(file, "%lx", &vendor) == 1;
+    fclose(file);
+    if (!read || vendor != kIntelVendorId)
+      continue;
+
+    snprintf(path, sizeof(path), "/dev/dri/renderD%u", kFirstRenderNode + i);
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+    if (fd < 0)
+      continue;
+    gbmDevice = gbm_create_device(fd);
+    if (gbmDevice)
+      return;
+    close(fd);
+  }
+  ALOGE("%s: no Intel render node", __func__);
+}
+
+bool IsHostBuffer(buffer_handle_t handle) {
+  return handle && handle->numFds == 1 &&
+         handle->numInts == kHandleIntCount &&
+         handle->data[1 + kHandleMagic] == kHandleMagicValue;
+}
+
+int GetHandleInt(buffer_handle_t handle, HandleInt index) {
+  return handle->data[1 + index];
+}
+
+struct Mapping {
+  void* data;
+  size_t size;
+};
+
+typedef std::unordered_map<buffer_handle_t, Mapping> Mappings;
+
+// CPU mappings of locked buffers. The map is never freed, so no destructor
+// runs at exit.
+pthread_mutex_t mappingsLock = PTHREAD_MUTEX_INITIALIZER;
+
+Mappings* GetMappings() {
+  static Mappings* mappings = new Mappings();
+  return mappings;
+}
+
+int MapBuffer(buffer_handle_t handle, int usage, void** data) {
+  const int fd = handle->data[0];
+  const off_t size = lseek(fd, 0, SEEK_END);
+  if (size <= 0)
+    return -EINVAL;
+
+  int prot = 0;
+  if (usage & GRALLOC_USAGE_SW_READ_MASK)
+    prot |= PROT_READ;
+  if (usage & GRALLOC_USAGE_SW_WRITE_MASK)
+    prot |= PROT_WRITE;
+  void* map = mmap(nullptr, static_cast<size_t>(size), prot ? prot : PROT_READ,
+                   MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED)
+    return -errno;
+
+  pthread_mutex_lock(&mappingsLock);
+  const bool inserted =
+      GetMappings()
+          ->emplace(handle, Mapping{map, static_cast<size_t>(size)})
+          .second;
+  pthread_mutex_unlock(&mappingsLock);
+  if (!inserted) {
+    munmap(map, static_cast<size_t>(size));
+    return -EBUSY;
+  }
+  *data = map;
+  return 0;
+}
+
+int RegisterBuffer(const gralloc_module_t* /*module*/,
+                   buffer_handle_t handle) {
+  return IsHostBuffer(handle) ? 0 : -EINVAL;
+}
+
+int UnregisterBuffer(const gralloc_module_t* /*module*/,
+                     buffer_handle_t handle) {
+  return IsHostBuffer(handle) ? 0 : -EINVAL;
+}
+
+// Tiled buffers map in their tiled layout, the mock does not detile.
+int Lock(const gralloc_module_t* /*module*/,
+         buffer_handle_t handle,
+         int usage,
+         int /*left*/,
+         int /*top*/,
+         int /*width*/,
+         int /*height*/,
+         void** data) {
+  if (!IsHostBuffer(handle))
+    return -EINVAL;
+  return MapBuffer(handle, usage, data);
+}
+
+int LockYCbCr(const gralloc_module_t* /*module*/,
+              buffer_handle_t handle,
+              int usage,
+              int /*left*/,
+              int /*top*/,
+              int /*width*/,
+              int /*height*/,
+              android_ycbcr* ycbcr) {
+  if (!IsHostBuffer(handle))
+    return -EINVAL;
+  const int format = GetHandleInt(handle, kHandleFormat);
+  if (format != HAL_PIXEL_FORMAT_YCbCr_420_888 &&
+      format != HAL_PIXEL_FORMAT_YV12)
+    return -EINVAL;
+
+  void* data;
+  int result = MapBuffer(handle, usage, &data);
+  if (result != 0)
+    return result;
+
+  uint8_t* luma = static_cast<uint8_t*>(data);
+  const size_t stride =
+      static_cast<size_t>(GetHandleInt(handle, kHandleByteStride));
+  const size_t height =
+      static_cast<size_t>(GetHandleInt(handle, kHandleHeight));
+  memset(ycbcr, 0, sizeof(*ycbcr));
+  ycbcr->y = luma;
+  ycbcr->ystride = stride;
+  if (format == HAL_PIXEL_FORMAT_YCbCr_420_888) {
+    ycbcr->cb = luma + stride * height;
+    ycbcr->cr = luma + stride * height + 1;
+    ycbcr->cstride = stride;
+    ycbcr->chroma_step = 2;
+  } else {
+    ycbcr->cr = luma + stride * height;
+    ycbcr->cb = luma + stride * height + stride / 2 * ((height + 1) / 2);
+    ycbcr->cstride = stride / 2;
+    ycbcr->chroma_step = 1;
+  }
+  return 0;
+}
+
+int Unlock(const gralloc_module_t* /*module*/, buffer_handle_t handle) {
+  Mapping mapping = {nullptr, 0};
+  pthread_mutex_lock(&mappingsLock);
+  Mappings* mappings = GetMappings();
+  auto found = mappings->find(handle);
+  if (found != mappings->end()) {
+    mapping = found->second;
+    mappings->erase(found);
+  }
+  pthread_mutex_unlock(&mappingsLock);
+  if (!mapping.data)
+    return -EINVAL;
+  munmap(mapping.data, mapping.size);
+  return 0;
+}
+
+int Alloc(alloc_device_t* /*device*/,
+          int width,
+          int height,
+          int format,
+          int /*usage*/,
+          buffer_handle_t* pHandle,
+          int* pStride) {
+  const FormatInfo* info = FindFormat(format);
+  if (!info || width <= 0 || height <= 0)
+    return -EINVAL;
+  pthread_once(&gbmOnce, OpenGbmDevice);
+  if (!gbmDevice)
+    return -ENODEV;
+
+  const uint32_t boWidth = static_cast<uint32_t>(width);
+  gbm_bo* bo;
+  if (info->yuv) {
+    // room for the chroma planes, half as tall as the luma plane
+    const uint32_t boHeight =
+        static_cast<uint32_t>(height + (height + 1) / 2);
+    bo = gbm_bo_create(gbmDevice, boWidth, boHeight, info->gbmFormat,
+                       GBM_BO_USE_LINEAR);
+  } else {
+    bo = gbm_bo_create_with_modifiers(gbmDevice, boWidth,
+                                      static_cast<uint32_t>(height),
+                                      info->gbmFormat, &kI915FormatModXTiled,
+                                      1);
+  }
+  if (!bo) {
+    ALOGE("%s: failed to allocate %dx%d of format %d", __func__, width,
+          height, format);
+    return -ENOMEM;
+  }
+
+  const int byteStride = static_cast<int>(gbm_bo_get_stride(bo));
+  const int fd = gbm_bo_get_fd(bo);
+  // the dma-buf keeps the memory alive
+  gbm_bo_destroy(bo);
+  // YV12 chroma planes are half the luma stride, which has to stay 16
+  // byte aligned
+  if (fd < 0 || byteStride % info->bytesPerPixel != 0 ||
+      (format == HAL_PIXEL_FORMAT_YV12 && byteStride % 32 != 0)) {
+    if (fd >= 0)
+      close(fd);
+    return -EINVAL;
+  }
+
+  native_handle_t* handle = native_handle_create(1, kHandleIntCount);
+  if (!handle) {
+    close(fd);
+    return -ENOMEM;
+  }
+  handle->data[0] = fd;
+  handle->data[1 + kHandleMagic] = kHandleMagicValue;
+  handle->data[1 + kHandleWidth] = width;
+  handle->data[1 + kHandleHeight] = height;
+  handle->data[1 + kHandleFormat] = format;
+  handle->data[1 + kHandleByteStride] = byteStride;
+
+  *pHandle = handle;
+  *pStride = byteStride / info->bytesPerPixel;
+  return 0;
+}
+
+int Free(alloc_device_t* /*device*/, buffer_handle_t handle) {
+  if (!IsHostBuffer(handle))
+    return -EINVAL;
+  native_handle_close(handle);
+  native_handle_delete(const_cast<native_handle_t*>(handle));
+  return 0;
+}
+
+int CloseDevice(hw_device_t* device) {
+  delete reinterpret_cast<alloc_device_t*>(device);
+  return 0;
+}
+
+int OpenDevice(const hw_module_t* module, const char* id,
+               hw_device_t** device) {
+  if (strcmp(id, GRALLOC_HARDWARE_GPU0) != 0)
+    return -ENOENT;
+
+  alloc_device_t* allocDevice = new alloc_device_t();
+  allocDevice->common.tag = HARDWARE_DEVICE_TAG;
+  allocDevice->common.version = 0;
+  allocDevice->common.module = const_cast<hw_module_t*>(module);
+  allocDevice->common.close = CloseDevice;
+  allocDevice->alloc = Alloc;
+  allocDevice->free = Free;
+  *device = &allocDevice->common;
+  return 0;
+}
+
+hw_module_methods_t gralloc_mod_methods = {.open = OpenDevice};
+}  // namespace
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wmissing-variable-declarations"
+__attribute__((visibility("default"))) gralloc_module_t HAL_MODULE_INFO_SYM = {
+    .common = {.tag = HARDWARE_MODULE_TAG,
+               .module_api_version = GRALLOC_MODULE_API_VERSION_0_2,
+               .hal_api_version = HARDWARE_HAL_API_VERSION,
+               .id = GRALLOC_HARDWARE_MODULE_ID,
+               .name = "GBM host gralloc",
+               .author = "Intel",
+               .methods = &gralloc_mod_methods},
+    .registerBuffer = RegisterBuffer,
+    .unregisterBuffer = UnregisterBuffer,
+    .lock = Lock,
+    .unlock = Unlock,
+    .lock_ycbcr = LockYCbCr,
+};
+#pragma clang diagnostic pop
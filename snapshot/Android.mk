@@ -0,0 +1,55 @@
+# Copyright (C) 2016 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+LOCAL_PATH := $(call my-dir)
+
+# Writes the instance extension snapshot of the driver the HAL selects on
+# the device it runs on, see vulkan_snapshot.h. A vendor executable, so it
+# loads the driver from the same place the HAL does.
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := vulkan_hal_snapshot.cpp \
+	../vulkan_driver.cpp \
+	../vulkan_snapshot.cpp \
+	../vulkan_stats.cpp \
+	../vulkan_wrapper.cpp
+LOCAL_CLANG := true
+LOCAL_CFLAGS := $(vulkan_hal_cflags) -DVK_USE_PLATFORM_ANDROID_KHR
+LOCAL_CPPFLAGS := $(vulkan_hal_cppflags)
+LOCAL_C_INCLUDES := $(vulkan_hal_c_includes) $(LOCAL_PATH)/..
+
+LOCAL_SHARED_LIBRARIES := liblog libdl libcutils
+
+LOCAL_MODULE := vulkan_hal_snapshot
+LOCAL_PROPRIETARY_MODULE := true
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+# The snapshot itself, installed read-only to /vendor/etc where every app
+# can map it. VULKAN_HAL_SNAPSHOT in the board config names a file that
+# vulkan_hal_snapshot wrote on a device running the same driver build; a
+# stale one is ignored, the board just loses the startup saving.
+ifneq ($(VULKAN_HAL_SNAPSHOT),)
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := vulkan_hal_snapshot_file
+LOCAL_MODULE_STEM := vulkan_hal_snapshot
+LOCAL_MODULE_CLASS := ETC
+LOCAL_PREBUILT_MODULE_FILE := $(VULKAN_HAL_SNAPSHOT)
+LOCAL_PROPRIETARY_MODULE := true
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_PREBUILT)
+endif
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Writes the instance extension snapshot of the driver the HAL selects on
+// this device, for the board to install read-only, see vulkan_snapshot.h:
+//   vulkan_hal_snapshot /data/local/tmp/vulkan_hal_snapshot
+// Run it again whenever the driver is rebuilt, the HAL ignores a snapshot
+// of any other build.
+
+#include <limits.h>
+#include <stdio.h>
+#include <vector>
+
+#include "vulkan_snapshot.h"
+#include "vulkan_wrapper.h"
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s <snapshot>\n", argv[0]);
+    return 1;
+  }
+  if (!mesa_vulkan::InitializeVulkan()) {
+    fprintf(stderr, "failed to load the driver\n");
+    return 1;
+  }
+
+  std::vector<VkExtensionProperties> extensions;
+  VkResult result;
+  do {
+    uint32_t count = 0;
+    result =
+        mesa_vulkan::vkEnumerateInstanceExtensionProperties(NULL, &count, NULL);
+    if (result != VK_SUCCESS)
+      break;
+    extensions.resize(count);
+    result = mesa_vulkan::vkEnumerateInstanceExtensionProperties(
+        NULL, &count, extensions.data());
+    extensions.resize(count);
+  } while (result == VK_INCOMPLETE);
+  if (result != VK_SUCCESS) {
+    fprintf(stderr, "failed to enumerate instance extensions: %d\n", result);
+    return 1;
+  }
+
+  char driverPath[PATH_MAX];
+  if (!mesa_vulkan::GetDriverPath(driverPath, sizeof(driverPath)) ||
+      !vulkan_hal::WriteExtensionSnapshot(
+          argv[1], extensions.data(), static_cast<uint32_t>(extensions.size()),
+          driverPath)) {
+    fprintf(stderr, "failed to write %s\n", argv[1]);
+    return 1;
+  }
+
+  printf("%zu instance extensions of %s\n", extensions.size(), driverPath);
+  return 0;
+}
@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <utility>
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#include "vulkan_acquire.h"
+#include "vulkan_arena.h"
+#include "vulkan_device.h"
+
+namespace vulkan_hal {
+
+namespace {
+
+// -1 until the property has been read
+std::atomic<int> acquireStrategy(-1);
+
+struct DeferredFence {
+  VkSemaphore semaphore;
+  FenceFd fence;
+};
+
+typedef ArenaVector<DeferredFence> DeferredFences;
+
+DeferredFence* FindDeferredFence(DeferredFences* fences,
+                                 VkSemaphore semaphore) {
+  DeferredFence* it = fences->begin();
+  while (it != fences->end() && it->semaphore != semaphore)
+    ++it;
+  return it;
+}
+
+// Takes the deferred fence of semaphore out of fences, returns false if it
+// has none.
+bool TakeDeferredFence(DeferredFences* fences,
+                       VkSemaphore semaphore,
+                       FenceFd* fence) {
+  DeferredFence* it = FindDeferredFence(fences, semaphore);
+  if (it == fences->end())
+    return false;
+  *fence = std::move(it->fence);
+  fences->erase(it);
+  return true;
+}
+
+}  // namespace
+
+struct DeferredAcquires {
+  explicit DeferredAcquires(Arena* arena)
+      : fences(arena) {}
+
+  std::mutex lock;
+  DeferredFences fences;
+  // size of fences, read without the lock to keep submissions cheap while
+  // nothing is deferred
+  std::atomic<uint32_t> count;
+};
+
+AcquireStrategy GetAcquireStrategy() {
+  int strategy = acquireStrategy.load(std::memory_order_relaxed);
+  if (strategy >= 0)
+    return static_cast<AcquireStrategy>(strategy);
+
+  char value[PROPERTY_VALUE_MAX];
+  property_get("debug.vulkan_hal.acquire", value, "import");
+  if (strcmp(value, "blocking") == 0) {
+    strategy = kAcquireBlocking;
+  } else if (strcmp(value, "deferred") == 0) {
+    strategy = kAcquireDeferred;
+  } else {
+    ALOGE_IF(strcmp(value, "import") != 0, "%s: unknown acquire strategy %s",
+             __func__, value);
+    strategy = kAcquireImport;
+  }
+
+  acquireStrategy.store(strategy, std::memory_order_relaxed);
+  return static_cast<AcquireStrategy>(strategy);
+}
+
+DeferredAcquires* CreateDeferredAcquires(Arena* arena) {
+  DeferredAcquires* acquires = ArenaNew<DeferredAcquires>(arena, arena);
+  if (!acquires)
+    return nullptr;
+  acquires->count.store(0, std::memory_order_relaxed);
+  return acquires;
+}
+
+void DestroyDeferredAcquires(DeviceContext* ctx) {
+  ArenaDelete(ctx->arena, ctx->deferredAcquires);
+  ctx->deferredAcquires = nullptr;
+}
+
+VkResult DeferAcquireFence(DeviceContext* ctx,
+                           VkSemaphore semaphore,
+                           FenceFd fence) {
+  DeferredAcquires* acquires = ctx->deferredAcquires;
+  // a semaphore acquired again before anything waited on it only needs the
+  // newer fence, the stale one is closed once the lock is dropped
+  FenceFd staleFence;
+  std::lock_guard<std::mutex> lock(acquires->lock);
+  DeferredFence* it = FindDeferredFence(&acquires->fences, semaphore);
+  if (it != acquires->fences.end()) {
+    staleFence = std::move(it->fence);
+    it->fence = std::move(fence);
+    return VK_SUCCESS;
+  }
+  if (!acquires->fences.push_back({semaphore, std::move(fence)})) {
+    ALOGE("%s: out of host memory", __func__);
+    return VK_ERROR_OUT_OF_HOST_MEMORY;
+  }
+  acquires->count.store(static_cast<uint32_t>(acquires->fences.size()),
+                        std::memory_order_release);
+  return VK_SUCCESS;
+}
+
+VkResult ResolveDeferredAcquires(DeviceContext* ctx,
+                                 uint32_t semaphoreCount,
+                                 const VkSemaphore* pSemaphores) {
+  DeferredAcquires* acquires = ctx->deferredAcquires;
+  if (acquires->count.load(std::memory_order_acquire) == 0)
+    return VK_SUCCESS;
+
+  VkResult result = VK_SUCCESS;
+  for (uint32_t i = 0; i < semaphoreCount; i++) {
+    FenceFd fence;
+    {
+      std::lock_guard<std::mutex> lock(acquires->lock);
+      if (!TakeDeferredFence(&acquires->fences, pSemaphores[i], &fence))
+        continue;
+      acquires->count.store(static_cast<uint32_t>(acquires->fences.size()),
+                            std::memory_order_release);
+    }
+
+    if (!ctx->importSemaphoreFd) {
+      fence.Wait();
+      continue;
+    }
+
+    // Imported even after an earlier failure, the fence is ours to get rid
+    // of. One that signaled while the app recorded its frame, the common
+    // case, is imported as -1 and spares the driver the sync_file.
+    fence.PollSignaled();
+    const VkImportSemaphoreFdInfoKHR info = {
+        .sType = VK_STRUCTURE_TYPE_IMPORT_SEMAPHORE_FD_INFO_KHR,
+        .pNext = NULL,
+        .semaphore = pSemaphores[i],
+        .flags = VK_SEMAPHORE_IMPORT_TEMPORARY_BIT_KHR,
+        .handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT_KHR,
+        .fd = fence.Get(),
+    };
+    VkResult importResult = ctx->importSemaphoreFd(ctx->device, &info);
+    if (importResult == VK_SUCCESS) {
+      fence.Release();
+    } else {
+      ALOGE("%s: failed to import acquire fence into semaphore", __func__);
+      result = importResult;
+    }
+  }
+
+  return result;
+}
+
+bool TakeDeferredAcquires(DeviceContext* ctx,
+                          uint32_t semaphoreCount,
+                          const VkSemaphore* pSemaphores,
+                          FenceFd* fences) {
+  DeferredAcquires* acquires = ctx->deferredAcquires;
+  if (acquires->count.load(std::memory_order_acquire) < semaphoreCount)
+    return false;
+
+  std::lock_guard<std::mutex> lock(acquires->lock);
+  for (uint32_t i = 0; i < semaphoreCount; i++) {
+    if (FindDeferredFence(&acquires->fences, pSemaphores[i]) ==
+        acquires->fences.end())
+      return false;
+  }
+  for (uint32_t i = 0; i < semaphoreCount; i++)
+    TakeDeferredFence(&acquires->fences, pSemaphores[i], &fences[i]);
+  acquires->count.store(static_cast<uint32_t>(acquires->fences.size()),
+                        std::memory_order_release);
+  return true;
+}
+
+void DropDeferredAcquire(DeviceContext* ctx, VkSemaphore semaphore) {
+  DeferredAcquires* acquires = ctx->deferredAcquires;
+  if (acquires->count.load(std::memory_order_acquire) == 0)
+    return;
+
+  // closed once the lock is dropped
+  FenceFd fence;
+  std::lock_guard<std::mutex> lock(acquires->lock);
+  if (!TakeDeferredFence(&acquires->fences, semaphore, &fence))
+    return;
+  acquires->count.store(static_cast<uint32_t>(acquires->fences.size()),
+                        std::memory_order_release);
+}
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_ACQUIRE_H
+#define VULKAN_ACQUIRE_H
+
+#define VK_NO_PROTOTYPES 1
+#include <vulkan/vulkan.h>
+
+#include "vulkan_fence.h"
+
+namespace vulkan_hal {
+
+struct Arena;
+struct DeviceContext;
+struct DeferredAcquires;
+
+// How AcquireImageANDROID hands the acquire fence to the app, picked with
+// the debug.vulkan_hal.acquire property.
+enum AcquireStrategy {
+  // "blocking": wait for the fence on the CPU before returning
+  kAcquireBlocking,
+  // "import" (default): import the fence into the semaphore and fence right
+  // away, falls back to blocking without sync_file import support
+  kAcquireImport,
+  // "deferred": keep the fence of the semaphore until a submission waits on
+  // it, so the app records its frame while the compositor still reads the
+  // buffer; blocks the submission instead without sync_file import support
+  kAcquireDeferred,
+};
+
+// Reads the property on first use, the strategy is fixed for the process.
+AcquireStrategy GetAcquireStrategy();
+
+DeferredAcquires* CreateDeferredAcquires(Arena* arena);
+
+// Closes the fences no submission waited on and frees the table.
+void DestroyDeferredAcquires(DeviceContext* ctx);
+
+// Keeps fence for the next submission waiting on semaphore. Out of host
+// memory the fence is closed and VK_ERROR_OUT_OF_HOST_MEMORY returned.
+VkResult DeferAcquireFence(DeviceContext* ctx,
+                           VkSemaphore semaphore,
+                           FenceFd fence);
+
+// Hands the deferred fences of the semaphores a submission is about to wait
+// on to the driver, or waits for them when it can not import them. Cheap
+// when nothing is deferred.
+VkResult ResolveDeferredAcquires(DeviceContext* ctx,
+                                 uint32_t semaphoreCount,
+                                 const VkSemaphore* pSemaphores);
+
+// Takes the deferred fences of all semaphores into fences, for a present
+// that waits on nothing but acquire semaphores and can pass their fences on
+// without a submission. Takes none and returns false if any semaphore has
+// no deferred fence.
+bool TakeDeferredAcquires(DeviceContext* ctx,
+                          uint32_t semaphoreCount,
+                          const VkSemaphore* pSemaphores,
+                          FenceFd* fences);
+
+// Drops the deferred fence of a semaphore that is being destroyed.
+void DropDeferredAcquire(DeviceContext* ctx, VkSemaphore semaphore);
+}
+
+#endif
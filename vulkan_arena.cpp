@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <mutex>
+
+#include "vulkan_arena.h"
+
+namespace vulkan_hal {
+
+namespace {
+
+// alignment of every allocation, and granularity of the size classes
+const size_t kArenaAlignment = 16;
+// larger allocations, like the proc cache table, go to the allocator
+// directly
+const size_t kMaxSmallSize = 512;
+const size_t kSizeClassCount = kMaxSmallSize / kArenaAlignment;
+const size_t kBlockSize = 16384;
+
+struct FreeObject {
+  FreeObject* next;
+};
+
+struct Block {
+  Block* next;
+};
+
+// the header of a block is padded so objects after it stay aligned
+const size_t kBlockHeaderSize =
+    (sizeof(Block) + kArenaAlignment - 1) & ~(kArenaAlignment - 1);
+
+void* AllocateHost(const VkAllocationCallbacks* allocator, size_t size) {
+  if (!allocator) {
+    void* memory;
+    return posix_memalign(&memory, kArenaAlignment, size) == 0 ? memory
+                                                               : nullptr;
+  }
+  return allocator->pfnAllocation(allocator->pUserData, size, kArenaAlignment,
+                                  VK_SYSTEM_ALLOCATION_SCOPE_DEVICE);
+}
+
+void FreeHost(const VkAllocationCallbacks* allocator, void* memory) {
+  if (!allocator)
+    free(memory);
+  else
+    allocator->pfnFree(allocator->pUserData, memory);
+}
+
+size_t SizeClass(size_t size) {
+  return size ? (size - 1) / kArenaAlignment : 0;
+}
+
+}  // namespace
+
+struct Arena {
+  // a copy, the app's pointer does not need to stay valid
+  bool hasAllocator;
+  VkAllocationCallbacks allocator;
+
+  std::mutex lock;
+  Block* blocks;
+  // unused tail of the newest block
+  char* bump;
+  char* bumpEnd;
+  FreeObject* freeLists[kSizeClassCount];
+
+  const VkAllocationCallbacks* Allocator() const {
+    return hasAllocator ? &allocator : nullptr;
+  }
+};
+
+Arena* CreateArena(const VkAllocationCallbacks* pAllocator) {
+  void* memory = AllocateHost(pAllocator, sizeof(Arena));
+  if (!memory)
+    return nullptr;
+
+  Arena* arena = new (memory) Arena();
+  arena->hasAllocator = pAllocator != NULL;
+  if (pAllocator)
+    arena->allocator = *pAllocator;
+  arena->blocks = nullptr;
+  arena->bump = nullptr;
+  arena->bumpEnd = nullptr;
+  for (size_t i = 0; i < kSizeClassCount; i++)
+    arena->freeLists[i] = nullptr;
+  return arena;
+}
+
+void DestroyArena(Arena* arena) {
+  const VkAllocationCallbacks* allocator = arena->Allocator();
+  Block* block = arena->blocks;
+  while (block) {
+    Block* next = block->next;
+    FreeHost(allocator, block);
+    block = next;
+  }
+
+  // the callbacks are needed past the arena's own destruction
+  VkAllocationCallbacks allocatorCopy = arena->allocator;
+  allocator = arena->hasAllocator ? &allocatorCopy : nullptr;
+  arena->~Arena();
+  FreeHost(allocator, arena);
+}
+
+void* ArenaAllocate(Arena* arena, size_t size) {
+  if (size > kMaxSmallSize)
+    return AllocateHost(arena->Allocator(), size);
+
+  const size_t sizeClass = SizeClass(size);
+  const size_t classSize = (sizeClass + 1) * kArenaAlignment;
+
+  std::lock_guard<std::mutex> lock(arena->lock);
+  FreeObject* object = arena->freeLists[sizeClass];
+  if (object) {
+    arena->freeLists[sizeClass] = object->next;
+    return object;
+  }
+
+  const size_t rest = static_cast<size_t>(arena->bumpEnd - arena->bump);
+  if (rest < classSize) {
+    // the rest of the old block is too small for this object, it is kept
+    // as a free object of the size class it fills exactly
+    if (rest) {
+      FreeObject* tail = reinterpret_cast<FreeObject*>(arena->bump);
+      tail->next = arena->freeLists[SizeClass(rest)];
+      arena->freeLists[SizeClass(rest)] = tail;
+      arena->bump = arena->bumpEnd;
+    }
+    void* memory = AllocateHost(arena->Allocator(), kBlockSize);
+    if (!memory)
+      return nullptr;
+    Block* block = static_cast<Block*>(memory);
+    block->next = arena->blocks;
+    arena->blocks = block;
+    arena->bump = static_cast<char*>(memory) + kBlockHeaderSize;
+    arena->bumpEnd = static_cast<char*>(memory) + kBlockSize;
+  }
+
+  void* memory = arena->bump;
+  arena->bump += classSize;
+  return memory;
+}
+
+void ArenaFree(Arena* arena, void* memory, size_t size) {
+  if (!memory)
+    return;
+  if (size > kMaxSmallSize) {
+    FreeHost(arena->Allocator(), memory);
+    return;
+  }
+
+  const size_t sizeClass = SizeClass(size);
+  FreeObject* object = static_cast<FreeObject*>(memory);
+  std::lock_guard<std::mutex> lock(arena->lock);
+  object->next = arena->freeLists[sizeClass];
+  arena->freeLists[sizeClass] = object;
+}
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_ARENA_H
+#define VULKAN_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <new>
+#include <utility>
+
+#define VK_NO_PROTOTYPES 1
+#include <vulkan/vulkan.h>
+
+namespace vulkan_hal {
+
+// Host memory for the bookkeeping of one device. It comes from the
+// allocation callbacks the app created the device with, or from the heap
+// without them, so the HAL's state counts against the app's budget. Small
+// objects are carved out of device scoped blocks and recycled through free
+// lists by size, so allocating one is a free list pop or a pointer bump.
+// Safe to use from any thread.
+struct Arena;
+
+// Returns NULL when out of host memory.
+Arena* CreateArena(const VkAllocationCallbacks* pAllocator);
+
+// Returns all blocks to the allocator, nothing allocated from the arena may
+// be used afterwards.
+void DestroyArena(Arena* arena);
+
+// Returns size bytes aligned for any object, or NULL when out of host
+// memory.
+void* ArenaAllocate(Arena* arena, size_t size);
+
+// Frees memory allocated with the same size.
+void ArenaFree(Arena* arena, void* memory, size_t size);
+
+template <typename T, typename... Args>
+T* ArenaNew(Arena* arena, Args&&... args) {
+  void* memory = ArenaAllocate(arena, sizeof(T));
+  return memory ? new (memory) T(std::forward<Args>(args)...) : nullptr;
+}
+
+template <typename T>
+void ArenaDelete(Arena* arena, T* object) {
+  if (!object)
+    return;
+  object->~T();
+  ArenaFree(arena, object, sizeof(T));
+}
+
+// Growable array kept in an arena, for the small tables hanging off a
+// device. Unlike a standard container it does not abort when out of host
+// memory: push_back and reserve return false and leave the array unchanged,
+// for the caller to fail with VK_ERROR_OUT_OF_HOST_MEMORY. Elements move
+// when the array grows or one before them is erased.
+template <typename T>
+class ArenaVector {
+ public:
+  explicit ArenaVector(Arena* arena)
+      : arena_(arena), data_(nullptr), size_(0), capacity_(0) {}
+  ~ArenaVector() {
+    clear();
+    ArenaFree(arena_, data_, capacity_ * sizeof(T));
+  }
+  ArenaVector(const ArenaVector&) = delete;
+  ArenaVector& operator=(const ArenaVector&) = delete;
+
+  T* begin() { return data_; }
+  T* end() { return data_ + size_; }
+  T& back() { return data_[size_ - 1]; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  bool reserve(size_t capacity) {
+    if (capacity <= capacity_)
+      return true;
+    if (capacity > SIZE_MAX / sizeof(T))
+      return false;
+    T* data = static_cast<T*>(ArenaAllocate(arena_, capacity * sizeof(T)));
+    if (!data)
+      return false;
+    for (size_t i = 0; i < size_; i++) {
+      new (&data[i]) T(std::move(data_[i]));
+      data_[i].~T();
+    }
+    ArenaFree(arena_, data_, capacity_ * sizeof(T));
+    data_ = data;
+    capacity_ = capacity;
+    return true;
+  }
+
+  bool push_back(T&& value) {
+    if (size_ == capacity_ && !reserve(capacity_ ? capacity_ * 2 : 4))
+      return false;
+    new (&data_[size_]) T(std::move(value));
+    size_++;
+    return true;
+  }
+
+  void pop_back() { data_[--size_].~T(); }
+
+  // Keeps the order of the elements after position.
+  void erase(T* position) {
+    for (T* next = position + 1; next != end(); position++, next++)
+      *position = std::move(*next);
+    pop_back();
+  }
+
+  void clear() {
+    while (size_)
+      pop_back();
+  }
+
+ private:
+  Arena* arena_;
+  T* data_;
+  size_t size_;
+  size_t capacity_;
+};
+}
+
+#endif
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "vulkan_chain.h"
+
+namespace vulkan_hal {
+
+namespace {
+
+// The VK_ANDROID_native_buffer types are hardcoded, the header defines them
+// with old style casts.
+const uint32_t kStructureTypeNativeBuffer = 1000010000;
+const uint32_t kStructureTypePresentationProperties = 1000010002;
+
+// Returns kChainStructCount for structures the HAL does not look at.
+ChainStruct GetChainStructType(VkStructureType sType) {
+  switch (static_cast<uint32_t>(sType)) {
+    case kStructureTypeNativeBuffer:
+      return kChainNativeBuffer;
+    case kStructureTypePresentationProperties:
+      return kChainPresentationProperties;
+    case VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_IMAGE_CREATE_INFO_KHR:
+      return kChainExternalMemoryImage;
+    case VK_STRUCTURE_TYPE_IMAGE_DRM_FORMAT_MODIFIER_LIST_CREATE_INFO_EXT:
+      return kChainModifierList;
+    case VK_STRUCTURE_TYPE_IMAGE_DRM_FORMAT_MODIFIER_EXPLICIT_CREATE_INFO_EXT:
+      return kChainModifierExplicit;
+    default:
+      return kChainStructCount;
+  }
+}
+
+}  // namespace
+
+void IndexChain(const void* chain, ChainIndex* index) {
+  for (uint32_t i = 0; i < kChainStructCount; i++)
+    index->structs[i] = nullptr;
+
+  for (const ChainHeader* header = static_cast<const ChainHeader*>(chain);
+       header; header = static_cast<const ChainHeader*>(header->pNext)) {
+    ChainStruct type = GetChainStructType(header->sType);
+    if (type != kChainStructCount && !index->structs[type])
+      index->structs[type] = header;
+  }
+}
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_CHAIN_H
+#define VULKAN_CHAIN_H
+
+#define VK_NO_PROTOTYPES 1
+#include <vulkan/vulkan.h>
+
+namespace vulkan_hal {
+
+// The pNext structures the wrappers look at.
+enum ChainStruct {
+  // VkNativeBufferANDROID
+  kChainNativeBuffer,
+  // VkPhysicalDevicePresentationPropertiesANDROID
+  kChainPresentationProperties,
+  // VkExternalMemoryImageCreateInfo
+  kChainExternalMemoryImage,
+  // VkImageDrmFormatModifierListCreateInfoEXT
+  kChainModifierList,
+  // VkImageDrmFormatModifierExplicitCreateInfoEXT
+  kChainModifierExplicit,
+  kChainStructCount
+};
+
+// The common head of every structure in a pNext chain.
+struct ChainHeader {
+  VkStructureType sType;
+  const void* pNext;
+};
+
+// The recognized structures of one chain, NULL for the ones it lacks.
+struct ChainIndex {
+  const ChainHeader* structs[kChainStructCount];
+};
+
+// Indexes chain in a single walk. Unknown structures are skipped, of
+// repeated ones the first counts.
+void IndexChain(const void* chain, ChainIndex* index);
+
+template <typename T>
+const T* GetChainStruct(const ChainIndex& index, ChainStruct type) {
+  return reinterpret_cast<const T*>(index.structs[type]);
+}
+
+// For the output chains of queries, which the caller owns and the HAL
+// fills in.
+template <typename T>
+T* GetOutputChainStruct(const ChainIndex& index, ChainStruct type) {
+  return const_cast<T*>(GetChainStruct<T>(index, type));
+}
+}
+
+#endif
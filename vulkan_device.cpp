@@ -0,0 +1,312 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <string.h>
+#include <atomic>
+#include <cutils/log.h>
+#include <hardware/hwvulkan.h>
+
+#include "vulkan_acquire.h"
+#include "vulkan_arena.h"
+#include "vulkan_device.h"
+#include "vulkan_image_cache.h"
+#include "vulkan_image_ring.h"
+#include "vulkan_import.h"
+#include "vulkan_instance.h"
+#include "vulkan_proc_cache.h"
+#include "vulkan_timing.h"
+#include "vulkan_wrapper.h"
+
+namespace vulkan_hal {
+
+namespace {
+
+// A process rarely has more than one or two devices, a fixed table keeps
+// lookups lock free: a context is only read through the slot whose device
+// matched, and a device can not be looked up while it is being destroyed.
+const uint32_t kMaxDevices = 8;
+
+struct DeviceSlot {
+  std::atomic<VkDevice> device;
+  // loader dispatch pointer of device, NULL until bound
+  std::atomic<const void*> dispatch;
+  DeviceContext* ctx;
+};
+
+DeviceSlot deviceSlots[kMaxDevices];
+
+// serializes registering and unregistering devices
+pthread_mutex_t deviceSlotsLock = PTHREAD_MUTEX_INITIALIZER;
+
+// serializes registering queues, of any device
+pthread_mutex_t queuesLock = PTHREAD_MUTEX_INITIALIZER;
+
+template <typename PFN>
+PFN GetProc(VkDevice device, const char* name) {
+  return reinterpret_cast<PFN>(mesa_vulkan::vkGetDeviceProcAddr(device, name));
+}
+
+QueueState* FindQueue(DeviceContext* ctx, VkQueue queue) {
+  QueueState* state = ctx->queues.load(std::memory_order_acquire);
+  while (state && state->queue != queue)
+    state = state->next;
+  return state;
+}
+
+// Queues are only there once the device was handed out, the driver's device
+// is still alive for their release semaphores.
+void DestroyQueues(DeviceContext* ctx) {
+  QueueState* state = ctx->queues.load(std::memory_order_relaxed);
+  while (state) {
+    QueueState* next = state->next;
+    if (state->releaseSemaphore != VK_NULL_HANDLE)
+      ctx->destroySemaphore(ctx->device, state->releaseSemaphore, NULL);
+    ArenaDelete(ctx->arena, state);
+    state = next;
+  }
+  ctx->queues.store(nullptr, std::memory_order_relaxed);
+}
+
+void DestroyContext(DeviceContext* ctx) {
+  DestroyQueues(ctx);
+  DestroyImageRing(ctx);
+  DestroyPresentTimings(ctx);
+  DestroyDeferredAcquires(ctx);
+  DestroyImportQueue(ctx);
+  DestroyImageCache(ctx);
+  DestroyProcCache(ctx);
+
+  Arena* arena = ctx->arena;
+  ArenaDelete(arena, ctx);
+  DestroyArena(arena);
+}
+
+}  // namespace
+
+VkResult RegisterDevice(VkPhysicalDevice physicalDevice,
+                        const VkDeviceCreateInfo* pCreateInfo,
+                        VkDevice device,
+                        const VkAllocationCallbacks* pAllocator) {
+  Arena* arena = CreateArena(pAllocator);
+  if (!arena)
+    return VK_ERROR_OUT_OF_HOST_MEMORY;
+  DeviceContext* ctx = ArenaNew<DeviceContext>(arena);
+  if (!ctx) {
+    DestroyArena(arena);
+    return VK_ERROR_OUT_OF_HOST_MEMORY;
+  }
+  ctx->device = device;
+  ctx->physicalDevice = physicalDevice;
+  ctx->arena = arena;
+  ctx->queues.store(nullptr, std::memory_order_relaxed);
+  // protected queues can only be created with the protectedMemory feature
+  ctx->protectedMemory = false;
+  for (uint32_t i = 0; i < pCreateInfo->queueCreateInfoCount; i++) {
+    if (pCreateInfo->pQueueCreateInfos[i].flags &
+        VK_DEVICE_QUEUE_CREATE_PROTECTED_BIT)
+      ctx->protectedMemory = true;
+  }
+  bool drmFormatModifier = false;
+  bool dmaBufMemory = false;
+  for (uint32_t i = 0; i < pCreateInfo->enabledExtensionCount; i++) {
+    const char* name = pCreateInfo->ppEnabledExtensionNames[i];
+    if (strcmp(name, VK_EXT_IMAGE_DRM_FORMAT_MODIFIER_EXTENSION_NAME) == 0)
+      drmFormatModifier = true;
+    else if (strcmp(name, VK_EXT_EXTERNAL_MEMORY_DMA_BUF_EXTENSION_NAME) == 0)
+      dmaBufMemory = true;
+  }
+  ctx->explicitDmaBufImport = drmFormatModifier && dmaBufMemory;
+  ctx->destroyDevice = GetProc<PFN_vkDestroyDevice>(device, "vkDestroyDevice");
+  ctx->getDeviceQueue =
+      GetProc<PFN_vkGetDeviceQueue>(device, "vkGetDeviceQueue");
+  ctx->queueSubmit = GetProc<PFN_vkQueueSubmit>(device, "vkQueueSubmit");
+  ctx->queueSubmit2 =
+      GetProc<PFN_vkQueueSubmit2KHR>(device, "vkQueueSubmit2");
+  ctx->queueSubmit2KHR =
+      GetProc<PFN_vkQueueSubmit2KHR>(device, "vkQueueSubmit2KHR");
+  ctx->queueBindSparse =
+      GetProc<PFN_vkQueueBindSparse>(device, "vkQueueBindSparse");
+  ctx->queueWaitIdle = GetProc<PFN_vkQueueWaitIdle>(device, "vkQueueWaitIdle");
+  ctx->createImage = GetProc<PFN_vkCreateImage>(device, "vkCreateImage");
+  ctx->destroyImage = GetProc<PFN_vkDestroyImage>(device, "vkDestroyImage");
+  ctx->getImageMemoryRequirements = GetProc<PFN_vkGetImageMemoryRequirements>(
+      device, "vkGetImageMemoryRequirements");
+  ctx->allocateMemory =
+      GetProc<PFN_vkAllocateMemory>(device, "vkAllocateMemory");
+  ctx->freeMemory = GetProc<PFN_vkFreeMemory>(device, "vkFreeMemory");
+  ctx->bindImageMemory =
+      GetProc<PFN_vkBindImageMemory>(device, "vkBindImageMemory");
+  ctx->createSemaphore =
+      GetProc<PFN_vkCreateSemaphore>(device, "vkCreateSemaphore");
+  ctx->destroySemaphore =
+      GetProc<PFN_vkDestroySemaphore>(device, "vkDestroySemaphore");
+  ctx->createDmaBufImage = GetProc<PFN_vkCreateDmaBufImageINTEL>(
+      device, "vkCreateDmaBufImageINTEL");
+  ctx->importSemaphoreFd =
+      GetProc<PFN_vkImportSemaphoreFdKHR>(device, "vkImportSemaphoreFdKHR");
+  ctx->importFenceFd =
+      GetProc<PFN_vkImportFenceFdKHR>(device, "vkImportFenceFdKHR");
+  ctx->getSemaphoreFd =
+      GetProc<PFN_vkGetSemaphoreFdKHR>(device, "vkGetSemaphoreFdKHR");
+  ctx->getMemoryFdProperties = GetProc<PFN_vkGetMemoryFdPropertiesKHR>(
+      device, "vkGetMemoryFdPropertiesKHR");
+  InstanceProcs instanceProcs;
+  const bool haveInstanceProcs =
+      GetPhysicalDeviceProcs(physicalDevice, &instanceProcs);
+  ctx->getPhysicalDeviceFormatProperties2 =
+      haveInstanceProcs ? instanceProcs.getPhysicalDeviceFormatProperties2
+                        : nullptr;
+  ctx->protectedMemoryTypeBits = 0;
+  if (haveInstanceProcs && instanceProcs.getPhysicalDeviceMemoryProperties) {
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    instanceProcs.getPhysicalDeviceMemoryProperties(physicalDevice,
+                                                    &memoryProperties);
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+      if (memoryProperties.memoryTypes[i].propertyFlags &
+          VK_MEMORY_PROPERTY_PROTECTED_BIT)
+        ctx->protectedMemoryTypeBits |= 1u << i;
+    }
+  }
+  ctx->procCache = CreateProcCache(arena);
+  ctx->imageCache = CreateImageCache(arena);
+  ctx->importQueue = CreateImportQueue(arena);
+  ctx->deferredAcquires = CreateDeferredAcquires(arena);
+  ctx->presentTimings = CreatePresentTimings(arena);
+  ctx->imageRing = CreateImageRing(arena);
+  if (!ctx->procCache || !ctx->imageCache || !ctx->importQueue ||
+      !ctx->deferredAcquires || !ctx->presentTimings || !ctx->imageRing) {
+    ALOGE("%s: out of host memory", __func__);
+    DestroyContext(ctx);
+    return VK_ERROR_OUT_OF_HOST_MEMORY;
+  }
+
+  bool registered = false;
+  pthread_mutex_lock(&deviceSlotsLock);
+  for (uint32_t i = 0; i < kMaxDevices && !registered; i++) {
+    if (deviceSlots[i].device.load(std::memory_order_relaxed) != VK_NULL_HANDLE)
+      continue;
+    deviceSlots[i].ctx = ctx;
+    deviceSlots[i].device.store(device, std::memory_order_release);
+    registered = true;
+  }
+  pthread_mutex_unlock(&deviceSlotsLock);
+
+  if (!registered) {
+    ALOGE("%s: more than %u devices", __func__, kMaxDevices);
+    DestroyContext(ctx);
+    return VK_ERROR_TOO_MANY_OBJECTS;
+  }
+
+  return VK_SUCCESS;
+}
+
+void UnregisterDevice(DeviceContext* ctx) {
+  pthread_mutex_lock(&deviceSlotsLock);
+  for (uint32_t i = 0; i < kMaxDevices; i++) {
+    if (deviceSlots[i].device.load(std::memory_order_relaxed) == ctx->device) {
+      deviceSlots[i].dispatch.store(nullptr, std::memory_order_release);
+      deviceSlots[i].device.store(VK_NULL_HANDLE, std::memory_order_release);
+      deviceSlots[i].ctx = nullptr;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&deviceSlotsLock);
+
+  DestroyContext(ctx);
+}
+
+DeviceContext* GetDeviceContext(VkDevice device) {
+  for (uint32_t i = 0; i < kMaxDevices; i++) {
+    if (deviceSlots[i].device.load(std::memory_order_acquire) == device)
+      return deviceSlots[i].ctx;
+  }
+  return nullptr;
+}
+
+void BindDeviceDispatch(DeviceContext* ctx) {
+  const void* dispatch = GetLoaderDispatch(ctx->device);
+  if (!dispatch)
+    return;
+
+  for (uint32_t i = 0; i < kMaxDevices; i++) {
+    if (deviceSlots[i].device.load(std::memory_order_relaxed) == ctx->device) {
+      deviceSlots[i].dispatch.store(dispatch, std::memory_order_release);
+      return;
+    }
+  }
+}
+
+const void* GetLoaderDispatch(const void* handle) {
+  const hwvulkan_dispatch_t* dispatch =
+      static_cast<const hwvulkan_dispatch_t*>(handle);
+  if (dispatch->magic == HWVULKAN_DISPATCH_MAGIC)
+    return nullptr;
+  return dispatch->vtbl;
+}
+
+DeviceContext* GetDispatchContext(const void* handle) {
+  const void* dispatch = GetLoaderDispatch(handle);
+  if (!dispatch)
+    return nullptr;
+
+  for (uint32_t i = 0; i < kMaxDevices; i++) {
+    if (deviceSlots[i].dispatch.load(std::memory_order_acquire) == dispatch)
+      return deviceSlots[i].ctx;
+  }
+  return nullptr;
+}
+
+QueueState* RegisterQueue(DeviceContext* ctx, VkQueue queue) {
+  QueueState* state = FindQueue(ctx, queue);
+  if (state)
+    return state;
+
+  // looked up again and inserted under one lock, two threads getting the
+  // same queue must not both register it
+  pthread_mutex_lock(&queuesLock);
+  state = FindQueue(ctx, queue);
+  if (!state) {
+    state = ArenaNew<QueueState>(ctx->arena);
+    if (state) {
+      state->queue = queue;
+      state->ctx = ctx;
+      state->releaseSemaphore = VK_NULL_HANDLE;
+      state->next = ctx->queues.load(std::memory_order_relaxed);
+      ctx->queues.store(state, std::memory_order_release);
+    } else {
+      ALOGE("%s: out of host memory for queue state", __func__);
+    }
+  }
+  pthread_mutex_unlock(&queuesLock);
+  return state;
+}
+
+QueueState* GetQueueState(VkQueue queue) {
+  DeviceContext* ctx = GetDispatchContext(queue);
+  if (ctx)
+    return FindQueue(ctx, queue);
+
+  QueueState* state = nullptr;
+  pthread_mutex_lock(&deviceSlotsLock);
+  for (uint32_t i = 0; i < kMaxDevices && !state; i++) {
+    if (deviceSlots[i].device.load(std::memory_order_relaxed) != VK_NULL_HANDLE)
+      state = FindQueue(deviceSlots[i].ctx, queue);
+  }
+  pthread_mutex_unlock(&deviceSlotsLock);
+  return state;
+}
+}
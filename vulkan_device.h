@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_DEVICE_H
+#define VULKAN_DEVICE_H
+
+#define VK_NO_PROTOTYPES 1
+#include <atomic>
+#include <vulkan/vulkan.h>
+
+#include "vulkan/vulkan_intel.h"
+
+namespace vulkan_hal {
+
+struct Arena;
+struct DeferredAcquires;
+struct ImageCache;
+struct ImageRing;
+struct ImportQueue;
+struct PresentTimings;
+struct ProcCache;
+struct DeviceContext;
+
+// Per-queue bookkeeping for the release fence, registered when the queue is
+// handed out by vkGetDeviceQueue and kept until the device goes away.
+struct QueueState {
+  VkQueue queue;
+  DeviceContext* ctx;
+  // signaled by the release submission and exported as a sync_file, created
+  // on first use
+  VkSemaphore releaseSemaphore;
+  QueueState* next;
+};
+
+// HAL state of one VkDevice, created by the vkCreateDevice wrapper and torn
+// down by the vkDestroyDevice one. The driver entry points the wrappers call
+// are resolved once here; extension entry points Mesa lacks are NULL.
+struct DeviceContext {
+  VkDevice device;
+  VkPhysicalDevice physicalDevice;
+  // holds the context itself and all the state hanging off it
+  Arena* arena;
+  // the device has a protected queue, so protected memory is enabled
+  bool protectedMemory;
+  // VK_EXT_image_drm_format_modifier and VK_EXT_external_memory_dma_buf are
+  // enabled, as the explicit dma-buf import needs. Mesa hands out their
+  // entry points whether they are or not.
+  bool explicitDmaBufImport;
+  // memory types with VK_MEMORY_PROPERTY_PROTECTED_BIT, which only protected
+  // images can be bound to
+  uint32_t protectedMemoryTypeBits;
+
+  PFN_vkDestroyDevice destroyDevice;
+  PFN_vkGetDeviceQueue getDeviceQueue;
+  PFN_vkQueueSubmit queueSubmit;
+  // the core and KHR names of the same entry point, NULL unless enabled
+  PFN_vkQueueSubmit2KHR queueSubmit2;
+  PFN_vkQueueSubmit2KHR queueSubmit2KHR;
+  PFN_vkQueueBindSparse queueBindSparse;
+  PFN_vkQueueWaitIdle queueWaitIdle;
+  PFN_vkCreateImage createImage;
+  PFN_vkDestroyImage destroyImage;
+  PFN_vkGetImageMemoryRequirements getImageMemoryRequirements;
+  PFN_vkAllocateMemory allocateMemory;
+  PFN_vkFreeMemory freeMemory;
+  PFN_vkBindImageMemory bindImageMemory;
+  PFN_vkCreateSemaphore createSemaphore;
+  PFN_vkDestroySemaphore destroySemaphore;
+  PFN_vkCreateDmaBufImageINTEL createDmaBufImage;
+  PFN_vkImportSemaphoreFdKHR importSemaphoreFd;
+  PFN_vkImportFenceFdKHR importFenceFd;
+  PFN_vkGetSemaphoreFdKHR getSemaphoreFd;
+  PFN_vkGetMemoryFdPropertiesKHR getMemoryFdProperties;
+  // of the physical device's instance
+  PFN_vkGetPhysicalDeviceFormatProperties2KHR
+      getPhysicalDeviceFormatProperties2;
+
+  ProcCache* procCache;
+  ImageCache* imageCache;
+  ImportQueue* importQueue;
+  DeferredAcquires* deferredAcquires;
+  PresentTimings* presentTimings;
+  ImageRing* imageRing;
+  // the queues handed out so far, only ever prepended to while the device
+  // lives, so it is walked without a lock
+  std::atomic<QueueState*> queues;
+};
+
+// Creates and publishes the context of a newly created device, allocated
+// with the callbacks the device was created with. Fails with
+// VK_ERROR_OUT_OF_HOST_MEMORY, or with VK_ERROR_TOO_MANY_OBJECTS when too
+// many devices are alive already.
+VkResult RegisterDevice(VkPhysicalDevice physicalDevice,
+                        const VkDeviceCreateInfo* pCreateInfo,
+                        VkDevice device,
+                        const VkAllocationCallbacks* pAllocator);
+
+// Unpublishes and frees the context of device, the caller tears down the
+// state hanging off it first.
+void UnregisterDevice(DeviceContext* ctx);
+
+// Returns the context of device, or NULL for devices the HAL did not create.
+// Takes no lock.
+DeviceContext* GetDeviceContext(VkDevice device);
+
+// Records the loader's dispatch pointer of the device, which the loader
+// writes into the first word of the handle once vkCreateDevice returned and
+// copies into every queue of the device. Call once the device was handed
+// out, a device not created through a loader has the dispatch magic there
+// and is not bound.
+void BindDeviceDispatch(DeviceContext* ctx);
+
+// Returns the loader's dispatch pointer of a dispatchable handle, or NULL
+// while it still holds the dispatch magic, as it does until the loader has
+// set it up or when there is no loader at all.
+const void* GetLoaderDispatch(const void* handle);
+
+// Returns the context of the device owning a dispatchable handle, such as
+// a queue, by its loader dispatch pointer. Takes no lock. Returns NULL if
+// the device is not bound.
+DeviceContext* GetDispatchContext(const void* handle);
+
+// Returns the state of queue on the device of ctx, registering it the first
+// time. NULL when out of host memory.
+QueueState* RegisterQueue(DeviceContext* ctx, VkQueue queue);
+
+// Returns the state of a queue handed out by vkGetDeviceQueue, NULL for any
+// other. Takes no lock under a loader, where the device is found by the
+// queue's dispatch pointer; without one the device slots are scanned under
+// their lock.
+QueueState* GetQueueState(VkQueue queue);
+}
+
+#endif
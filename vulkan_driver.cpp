@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#include "vulkan_driver.h"
+
+namespace vulkan_hal {
+
+namespace {
+
+const unsigned long kIntelVendorId = 0x8086;
+
+// render nodes are numbered from 128, one for each of up to 64 GPUs
+const uint32_t kFirstRenderNode = 128;
+const uint32_t kRenderNodeCount = 64;
+
+struct GenerationRange {
+  uint32_t firstDeviceId;
+  uint32_t lastDeviceId;
+  const char* generation;
+};
+
+// The PCI ids of each generation the generation specific libraries are
+// built for, from the kernel's i915_pciids.h. Ranges never overlap and
+// only span ids of one generation; ids not in here, Sandy Bridge and
+// anything newer included, get the generic library.
+const GenerationRange kGenerations[] = {
+    {0x0152, 0x016a, "gen7"},   // Ivy Bridge, Bay Trail
+    {0x0402, 0x042e, "gen75"},  // Haswell
+    {0x0a02, 0x0a2e, "gen75"},  // Haswell ULT
+    {0x0a84, 0x0a84, "gen9"},   // Broxton
+    {0x0c02, 0x0c2e, "gen75"},  // Haswell SDV
+    {0x0d02, 0x0d2e, "gen75"},  // Haswell CRW
+    {0x0f30, 0x0f33, "gen7"},   // Bay Trail
+    {0x1602, 0x163e, "gen8"},   // Broadwell
+    {0x1902, 0x193d, "gen9"},   // Skylake
+    {0x1a84, 0x1a85, "gen9"},   // Broxton
+    {0x22b0, 0x22b3, "gen8"},   // Cherryview
+    {0x3184, 0x3185, "gen9"},   // Gemini Lake
+    {0x3e90, 0x3ea9, "gen9"},   // Coffee Lake
+    {0x4500, 0x4571, "gen11"},  // Elkhart Lake
+    {0x4680, 0x46d4, "gen12"},  // Alder Lake
+    {0x4c8a, 0x4c9a, "gen12"},  // Rocket Lake
+    {0x4e51, 0x4e71, "gen11"},  // Jasper Lake
+    {0x5902, 0x593b, "gen9"},   // Kaby Lake
+    {0x5a40, 0x5a5c, "gen10"},  // Cannonlake
+    {0x5a84, 0x5a85, "gen9"},   // Broxton
+    {0x87c0, 0x87ca, "gen9"},   // Amber Lake
+    {0x8a50, 0x8a71, "gen11"},  // Ice Lake
+    {0x9a40, 0x9af8, "gen12"},  // Tiger Lake
+    {0x9b21, 0x9bf6, "gen9"},   // Comet Lake
+};
+
+// Reads a hex sysfs attribute like "0x8086\n", returns false if it can not.
+bool ReadSysfsId(const char* path, unsigned long* id) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  char value[16];
+  ssize_t size = read(fd, value, sizeof(value) - 1);
+  close(fd);
+  if (size <= 0)
+    return false;
+  value[size] = '\0';
+
+  char* end;
+  *id = strtoul(value, &end, 16);
+  return end != value;
+}
+
+// Finds the PCI device id and render node of the first Intel GPU with a
+// render node, the same one Mesa picks. Goes through sysfs, opening the
+// node itself would need the permissions of a DRM client.
+bool FindIntelDeviceId(uint32_t* deviceId, uint32_t* renderNode) {
+  for (uint32_t i = 0; i < kRenderNodeCount; i++) {
+    char path[64];
+    unsigned long vendor;
+    snprintf(path, sizeof(path), "/sys/class/drm/renderD%u/device/vendor",
+             kFirstRenderNode + i);
+    if (!ReadSysfsId(path, &vendor) || vendor != kIntelVendorId)
+      continue;
+
+    unsigned long device;
+    snprintf(path, sizeof(path), "/sys/class/drm/renderD%u/device/device",
+             kFirstRenderNode + i);
+    if (!ReadSysfsId(path, &device))
+      continue;
+    *deviceId = static_cast<uint32_t>(device);
+    *renderNode = kFirstRenderNode + i;
+    return true;
+  }
+  return false;
+}
+
+const char* GetGeneration(uint32_t deviceId) {
+  for (const GenerationRange& range : kGenerations) {
+    if (deviceId >= range.firstDeviceId && deviceId <= range.lastDeviceId)
+      return range.generation;
+  }
+  return nullptr;
+}
+
+void AddCandidate(DriverCandidates* candidates,
+                  const char* name,
+                  size_t length) {
+  if (candidates->count >= kMaxDriverCandidates || length == 0 ||
+      length >= kMaxDriverName) {
+    ALOGW_IF(length >= kMaxDriverName, "%s: driver name too long", __func__);
+    return;
+  }
+  char* entry = candidates->names[candidates->count];
+  memcpy(entry, name, length);
+  entry[length] = '\0';
+  for (uint32_t i = 0; i < candidates->count; i++) {
+    if (strcmp(candidates->names[i], entry) == 0)
+      return;
+  }
+  candidates->count++;
+}
+
+// Adds the libraries of the entries of config whose match is the given
+// one.
+void AddConfiguredCandidates(DriverCandidates* candidates,
+                             const char* config,
+                             const char* match) {
+  const size_t matchLength = strlen(match);
+  const char* entry = config;
+  while (*entry) {
+    const char* end = strchr(entry, ',');
+    if (!end)
+      end = entry + strlen(entry);
+    const char* library = static_cast<const char*>(
+        memchr(entry, '=', static_cast<size_t>(end - entry)));
+    if (!library) {
+      ALOGW("%s: ignoring driver entry without '='", __func__);
+    } else if (static_cast<size_t>(library - entry) == matchLength &&
+               strncasecmp(entry, match, matchLength) == 0) {
+      library++;
+      AddCandidate(candidates, library, static_cast<size_t>(end - library));
+    }
+    entry = *end ? end + 1 : end;
+  }
+}
+
+}  // namespace
+
+void GetDriverCandidates(DriverCandidates* candidates) {
+  candidates->count = 0;
+
+  uint32_t deviceId;
+  uint32_t renderNode;
+  if (FindIntelDeviceId(&deviceId, &renderNode)) {
+    char id[8];
+    snprintf(id, sizeof(id), "0x%04x", deviceId);
+    const char* generation = GetGeneration(deviceId);
+    ALOGV("%s: Intel GPU %s, %s", __func__, id,
+          generation ? generation : "unknown generation");
+
+    char config[PROPERTY_VALUE_MAX];
+    property_get("ro.vulkan_hal.drivers", config, "");
+    AddConfiguredCandidates(candidates, config, id);
+    if (generation) {
+      AddConfiguredCandidates(candidates, config, generation);
+      char name[kMaxDriverName];
+      int length =
+          snprintf(name, sizeof(name), "libvulkan_intel_%s.so", generation);
+      AddCandidate(candidates, name, static_cast<size_t>(length));
+    }
+  }
+
+  // the generic build always gets the last slot
+  if (candidates->count == kMaxDriverCandidates)
+    candidates->count--;
+  AddCandidate(candidates, kGenericDriver, strlen(kGenericDriver));
+}
+
+int OpenRenderNode() {
+  uint32_t deviceId;
+  uint32_t renderNode;
+  if (!FindIntelDeviceId(&deviceId, &renderNode))
+    return -1;
+
+  char path[32];
+  snprintf(path, sizeof(path), "/dev/dri/renderD%u", renderNode);
+  int fd = open(path, O_RDWR | O_CLOEXEC);
+  ALOGE_IF(fd < 0, "%s: failed to open %s: %d", __func__, path, errno);
+  return fd;
+}
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_DRIVER_H
+#define VULKAN_DRIVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace vulkan_hal {
+
+// The driver build that runs on every supported GPU, always tried last.
+const char* const kGenericDriver = "libvulkan_intel.so";
+
+const uint32_t kMaxDriverCandidates = 4;
+const size_t kMaxDriverName = 64;
+
+// Driver libraries to try in order, the first one that loads is used.
+struct DriverCandidates {
+  uint32_t count;
+  char names[kMaxDriverCandidates][kMaxDriverName];
+};
+
+// Lists the driver builds for the Intel GPU behind the first render node
+// that has one, identified by its PCI device id:
+//  - the entries of the ro.vulkan_hal.drivers property matching the device,
+//    a comma separated list of <match>=<library> where match is either the
+//    PCI device id, like 0x5917, or a generation, like gen9, and exact ids
+//    are preferred over generations
+//  - libvulkan_intel_<generation>.so
+//  - kGenericDriver
+// Only kGenericDriver is listed when no Intel GPU is found.
+void GetDriverCandidates(DriverCandidates* candidates);
+
+// Opens the render node of the GPU GetDriverCandidates looks at, for the
+// HAL's own DRM ioctls. Returns -1 if there is no Intel GPU or its node can
+// not be opened.
+int OpenRenderNode();
+}
+
+#endif
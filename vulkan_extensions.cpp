@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <string.h>
+#include <cutils/log.h>
+
+#include "vulkan_extensions.h"
+#include "vulkan_snapshot.h"
+#include "vulkan_wrapper.h"
+
+namespace vulkan_hal {
+
+namespace {
+
+pthread_mutex_t extensionsLock = PTHREAD_MUTEX_INITIALIZER;
+// driver's instance extensions, NULL until queried, either on the heap or
+// in the mapped snapshot
+const VkExtensionProperties* extensions = nullptr;
+uint32_t extensionCount = 0;
+
+VkResult QueryDriverExtensions() {
+  if (!mesa_vulkan::InitializeVulkan())
+    return VK_ERROR_INITIALIZATION_FAILED;
+
+  for (;;) {
+    uint32_t count = 0;
+    VkResult result =
+        mesa_vulkan::vkEnumerateInstanceExtensionProperties(NULL, &count, NULL);
+    if (result != VK_SUCCESS)
+      return result;
+
+    VkExtensionProperties* properties = new VkExtensionProperties[count];
+    result = mesa_vulkan::vkEnumerateInstanceExtensionProperties(NULL, &count,
+                                                                 properties);
+    if (result == VK_SUCCESS) {
+      extensions = properties;
+      extensionCount = count;
+      return VK_SUCCESS;
+    }
+
+    delete[] properties;
+    if (result != VK_INCOMPLETE)
+      return result;
+  }
+}
+
+}  // namespace
+
+VkResult EnumerateInstanceExtensionProperties(
+    const char* layerName,
+    uint32_t* pCount,
+    VkExtensionProperties* pProperties) {
+  if (layerName) {
+    if (!mesa_vulkan::InitializeVulkan())
+      return VK_ERROR_INITIALIZATION_FAILED;
+    return mesa_vulkan::vkEnumerateInstanceExtensionProperties(
+        layerName, pCount, pProperties);
+  }
+
+  VkResult result = VK_SUCCESS;
+  pthread_mutex_lock(&extensionsLock);
+  if (!extensions)
+    extensions = MapExtensionSnapshot(&extensionCount);
+  if (!extensions)
+    result = QueryDriverExtensions();
+  pthread_mutex_unlock(&extensionsLock);
+
+  if (result != VK_SUCCESS)
+    return result;
+
+  if (!pProperties) {
+    *pCount = extensionCount;
+    return VK_SUCCESS;
+  }
+
+  uint32_t count = *pCount < extensionCount ? *pCount : extensionCount;
+  memcpy(pProperties, extensions, count * sizeof(VkExtensionProperties));
+  *pCount = count;
+
+  return count < extensionCount ? VK_INCOMPLETE : VK_SUCCESS;
+}
+}
@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_EXTENSIONS_H
+#define VULKAN_EXTENSIONS_H
+
+#define VK_NO_PROTOTYPES 1
+#include <vulkan/vulkan.h>
+
+namespace vulkan_hal {
+
+// vkEnumerateInstanceExtensionProperties of the driver. The driver's list
+// is queried once and served from memory afterwards, and it is taken from
+// the on-disk snapshot when there is one for the installed driver, in which
+// case the driver is not loaded at all.
+VkResult EnumerateInstanceExtensionProperties(
+    const char* layerName,
+    uint32_t* pCount,
+    VkExtensionProperties* pProperties);
+}
+
+#endif
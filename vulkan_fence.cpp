@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <unistd.h>
+#include <utility>
+#include <cutils/log.h>
+#include <sync/sync.h>
+
+#include "vulkan_fence.h"
+#include "vulkan_stats.h"
+
+namespace vulkan_hal {
+
+void FenceFd::Reset(int fd) {
+  if (fd_ >= 0 && close(fd_) != 0)
+    ALOGE("%s: failed to close fence fd %d: %d", __func__, fd_, errno);
+  fd_ = fd;
+}
+
+bool FenceFd::PollSignaled() {
+  if (fd_ < 0)
+    return true;
+  // a timeout of 0 polls the fence, failing with ETIME while it is pending
+  if (sync_wait(fd_, 0) != 0)
+    return false;
+  CountStat(kStatFenceSignaled);
+  Reset();
+  return true;
+}
+
+void FenceFd::Wait() {
+  if (fd_ < 0)
+    return;
+  {
+    ScopedStat stat(kStatAcquireWait, "sync_wait");
+    sync_wait(fd_, -1);
+  }
+  Reset();
+}
+
+bool FenceFd::GetSignalTime(uint64_t* ns) const {
+  if (fd_ < 0)
+    return false;
+  struct sync_fence_info_data* info = sync_fence_info(fd_);
+  if (!info)
+    return false;
+
+  // a status of 1 is signaled, 0 still active and negative an error
+  const bool signaled = info->status == 1;
+  uint64_t latest = 0;
+  for (struct sync_pt_info* pt = sync_pt_info(info, NULL); pt;
+       pt = sync_pt_info(info, pt)) {
+    if (pt->timestamp_ns > latest)
+      latest = pt->timestamp_ns;
+  }
+  sync_fence_info_free(info);
+
+  if (signaled)
+    *ns = latest;
+  return signaled;
+}
+
+FenceFd MergeFences(FenceFd* fences, uint32_t count) {
+  FenceFd merged;
+  for (uint32_t i = 0; i < count; i++) {
+    if (fences[i].Get() < 0)
+      continue;
+    if (merged.Get() < 0) {
+      merged = std::move(fences[i]);
+      continue;
+    }
+    // polling is cheaper than a merge that creates a new sync_file
+    if (fences[i].PollSignaled())
+      continue;
+
+    ScopedStat stat(kStatFenceMerge, "sync_merge");
+    int fd = sync_merge("vulkan_hal", merged.Get(), fences[i].Get());
+    if (fd < 0) {
+      ALOGE("%s: failed to merge fences: %d", __func__, errno);
+      fences[i].Wait();
+      continue;
+    }
+    merged.Reset(fd);
+    fences[i].Reset();
+  }
+  return merged;
+}
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_FENCE_H
+#define VULKAN_FENCE_H
+
+#include <stdint.h>
+
+namespace vulkan_hal {
+
+// Owns a sync_file fd and closes it when it goes out of scope, so every
+// native fence the HAL is handed or exports is closed exactly once. An fd of
+// -1 stands for a fence that has already signaled, as in
+// VK_ANDROID_native_buffer.
+class FenceFd {
+ public:
+  FenceFd() : fd_(-1) {}
+  explicit FenceFd(int fd) : fd_(fd) {}
+  ~FenceFd() { Reset(); }
+
+  FenceFd(FenceFd&& other) : fd_(other.Release()) {}
+  FenceFd& operator=(FenceFd&& other) {
+    if (this != &other)
+      Reset(other.Release());
+    return *this;
+  }
+
+  FenceFd(const FenceFd&) = delete;
+  FenceFd& operator=(const FenceFd&) = delete;
+
+  int Get() const { return fd_; }
+
+  // Hands the fd over to the caller, who has to close it.
+  int Release() {
+    int fd = fd_;
+    fd_ = -1;
+    return fd;
+  }
+
+  // Closes the owned fd, if any, and takes fd instead.
+  void Reset(int fd = -1);
+
+  // Checks without blocking whether the fence has signaled, and if so closes
+  // the fd right away so that it is passed on as -1. A fence of -1 has
+  // signaled.
+  bool PollSignaled();
+
+  // Blocks until the fence signaled, then closes the fd.
+  void Wait();
+
+  // Returns false while the fence is pending. Once it signaled returns true
+  // with the CLOCK_MONOTONIC time its last sync point signaled at, read
+  // from the sync_file info. Does not block.
+  bool GetSignalTime(uint64_t* ns) const;
+
+ private:
+  int fd_;
+};
+
+// Merges fences into a single sync_file that signals once all of them have,
+// taking ownership of all of them. Fences that already signaled are left
+// out, so merging one pending fence hands it over without a syscall. A
+// fence that can not be merged is waited for instead.
+FenceFd MergeFences(FenceFd* fences, uint32_t count);
+}
+
+#endif
@@ -0,0 +1,281 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sys/types.h>
+#include <unistd.h>
+#include <cutils/log.h>
+#include <cutils/native_handle.h>
+#include <system/graphics.h>
+
+#include "vulkan_format.h"
+#include "vulkan_gralloc.h"
+#include "vulkan_modifier.h"
+
+namespace vulkan_hal {
+
+namespace {
+
+// Single plane color formats Mesa can import from a dma-buf.
+const FormatInfo kFormats[] = {
+    {VK_FORMAT_R5G6B5_UNORM_PACK16, 2, true},
+    {VK_FORMAT_R8G8B8A8_UNORM, 4, true},
+    {VK_FORMAT_R8G8B8A8_SRGB, 4, true},
+    {VK_FORMAT_B8G8R8A8_UNORM, 4, true},
+    {VK_FORMAT_B8G8R8A8_SRGB, 4, true},
+    {VK_FORMAT_A2B10G10R10_UNORM_PACK32, 4, true},
+    {VK_FORMAT_R16G16B16A16_SFLOAT, 8, false},
+};
+
+struct HalFormatInfo {
+  int halFormat;
+  uint32_t bytesPerPixel;
+};
+
+const HalFormatInfo kHalFormats[] = {
+    {HAL_PIXEL_FORMAT_RGB_565, 2},
+    {HAL_PIXEL_FORMAT_RGBA_8888, 4},
+    {HAL_PIXEL_FORMAT_RGBX_8888, 4},
+    {HAL_PIXEL_FORMAT_BGRA_8888, 4},
+    {HAL_PIXEL_FORMAT_RGBA_1010102, 4},
+    {HAL_PIXEL_FORMAT_RGBA_FP16, 8},
+};
+
+// fourcc 'NV12', which Intel's gralloc allocates flexible YUV buffers as
+const int kHalPixelFormatNV12 = 0x3231564E;
+
+// How the chroma samples of a format are stored, where the planes are and
+// how their rows are padded is up to gralloc.
+enum PlanarLayout {
+  // one plane of interleaved Cb and Cr samples, Cb first
+  kLayoutNV12,
+  // separate Cb and Cr planes
+  kLayoutYV12,
+};
+
+struct PlanarFormatInfo {
+  VkFormat format;
+  int halFormat;
+  PlanarLayout layout;
+};
+
+const PlanarFormatInfo kPlanarFormats[] = {
+    {VK_FORMAT_G8_B8R8_2PLANE_420_UNORM, kHalPixelFormatNV12, kLayoutNV12},
+    {VK_FORMAT_G8_B8R8_2PLANE_420_UNORM, HAL_PIXEL_FORMAT_YCbCr_420_888,
+     kLayoutNV12},
+    {VK_FORMAT_G8_B8_R8_3PLANE_420_UNORM, HAL_PIXEL_FORMAT_YV12, kLayoutYV12},
+};
+
+// rows of an X tiled buffer span whole X tiles
+const uint32_t kTileXWidthInBytes = 512;
+
+template <typename T, size_t N>
+constexpr size_t ArraySize(const T (&)[N]) {
+  return N;
+}
+
+// The layout of a buffer whose layout gralloc can not be asked for, as its
+// format defines it: the luma plane at the buffer's stride and padded to
+// the lines gralloc aligns heights to, then for NV12 the CbCr plane at the
+// same pitch and for YV12 the Cr and Cb planes at half the luma pitch
+// aligned to 16 bytes, see system/graphics.h.
+bool GetDefaultYCbCrLayout(PlanarLayout planarLayout,
+                           const VkNativeBufferANDROID* buffer,
+                           const VkExtent3D& extent,
+                           GrallocYCbCrLayout* ycbcr) {
+  if (buffer->stride <= 0) {
+    ALOGE("%s: invalid gralloc stride %d", __func__, buffer->stride);
+    return false;
+  }
+
+  const VkDeviceSize alignment = GetGrallocYuvHeightAlignment();
+  const VkDeviceSize lumaLines =
+      (extent.height + alignment - 1) / alignment * alignment;
+  // one byte per luma sample in all of them
+  ycbcr->lumaPitch = static_cast<VkDeviceSize>(buffer->stride);
+  const VkDeviceSize lumaSize = ycbcr->lumaPitch * lumaLines;
+  switch (planarLayout) {
+    case kLayoutNV12:
+      ycbcr->cbOffset = lumaSize;
+      ycbcr->crOffset = lumaSize + 1;
+      ycbcr->chromaPitch = ycbcr->lumaPitch;
+      ycbcr->chromaStep = 2;
+      break;
+    case kLayoutYV12:
+      ycbcr->chromaPitch = (ycbcr->lumaPitch / 2 + 15) & ~15ull;
+      ycbcr->crOffset = lumaSize;
+      ycbcr->cbOffset = lumaSize + ycbcr->chromaPitch * (lumaLines / 2);
+      ycbcr->chromaStep = 1;
+      break;
+  }
+  return true;
+}
+
+// Checks that the last chroma plane of layout ends within the dma-buf, so
+// that a wrong layout fails here rather than on the GPU.
+bool FitsDmaBuf(const VkNativeBufferANDROID* buffer,
+                const VkExtent3D& extent,
+                const GrallocYCbCrLayout& ycbcr) {
+  const native_handle_t* handle =
+      reinterpret_cast<const native_handle_t*>(buffer->handle);
+  const off_t size = lseek(handle->data[0], 0, SEEK_END);
+  // kernels before 3.15 can not tell, leave it to the import
+  if (size < 0)
+    return true;
+
+  const VkDeviceSize chromaLines = (extent.height + 1) / 2;
+  const VkDeviceSize lastPlane =
+      ycbcr.cbOffset > ycbcr.crOffset ? ycbcr.cbOffset : ycbcr.crOffset;
+  const VkDeviceSize end = lastPlane + ycbcr.chromaPitch * chromaLines -
+                           (ycbcr.chromaStep == 2 ? 1 : 0);
+  if (end > static_cast<VkDeviceSize>(size)) {
+    ALOGE("%s: planes end at %llu, past the %lld bytes of the dma-buf",
+          __func__, static_cast<unsigned long long>(end),
+          static_cast<long long>(size));
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+const FormatInfo* FindFormatInfo(VkFormat format) {
+  for (size_t i = 0; i < ArraySize(kFormats); i++) {
+    if (kFormats[i].format == format)
+      return &kFormats[i];
+  }
+  return nullptr;
+}
+
+VkResult GetDmaBufLayout(VkFormat format,
+                         uint64_t modifier,
+                         const VkNativeBufferANDROID* buffer,
+                         DmaBufLayout* layout) {
+  const FormatInfo* info = FindFormatInfo(format);
+  if (!info) {
+    ALOGE("%s: can not import format %d", __func__, format);
+    return VK_ERROR_FORMAT_NOT_SUPPORTED;
+  }
+
+  const uint32_t bytesPerPixel = info->bytesPerPixel;
+
+  // the stride is counted in pixels of the gralloc format, which only has
+  // to agree with the Vulkan format in size. A format of unknown size could
+  // make the stride in bytes anything, reject it.
+  const HalFormatInfo* halInfo = nullptr;
+  for (size_t i = 0; i < ArraySize(kHalFormats); i++) {
+    if (kHalFormats[i].halFormat == buffer->format) {
+      halInfo = &kHalFormats[i];
+      break;
+    }
+  }
+
+  if (!halInfo) {
+    ALOGE("%s: unknown gralloc format %d", __func__, buffer->format);
+    return VK_ERROR_FORMAT_NOT_SUPPORTED;
+  }
+  if (halInfo->bytesPerPixel != bytesPerPixel) {
+    ALOGE("%s: format %d does not match gralloc format %d", __func__, format,
+          buffer->format);
+    return VK_ERROR_FORMAT_NOT_SUPPORTED;
+  }
+
+  if (buffer->stride <= 0) {
+    ALOGE("%s: invalid gralloc stride %d", __func__, buffer->stride);
+    return VK_ERROR_FORMAT_NOT_SUPPORTED;
+  }
+
+  layout->bytesPerPixel = bytesPerPixel;
+  layout->strideInBytes =
+      static_cast<uint32_t>(buffer->stride) * bytesPerPixel;
+
+  if (modifier == kI915FormatModXTiled &&
+      layout->strideInBytes % kTileXWidthInBytes) {
+    ALOGE("%s: stride %u is not X tile aligned", __func__,
+          layout->strideInBytes);
+    return VK_ERROR_FORMAT_NOT_SUPPORTED;
+  }
+
+  return VK_SUCCESS;
+}
+
+bool IsPlanarFormat(VkFormat format) {
+  for (size_t i = 0; i < ArraySize(kPlanarFormats); i++) {
+    if (kPlanarFormats[i].format == format)
+      return true;
+  }
+  return false;
+}
+
+VkResult GetDmaBufPlanarLayout(VkFormat format,
+                               const VkExtent3D& extent,
+                               const VkNativeBufferANDROID* buffer,
+                               DmaBufPlanarLayout* layout) {
+  const PlanarFormatInfo* info = nullptr;
+  for (size_t i = 0; i < ArraySize(kPlanarFormats); i++) {
+    if (kPlanarFormats[i].format == format &&
+        kPlanarFormats[i].halFormat == buffer->format) {
+      info = &kPlanarFormats[i];
+      break;
+    }
+  }
+
+  if (!info) {
+    ALOGE("%s: can not import gralloc format 0x%x as format %d", __func__,
+          buffer->format, format);
+    return VK_ERROR_FORMAT_NOT_SUPPORTED;
+  }
+
+  // Heights get aligned by gralloc, a 1080 line buffer may well have 1088
+  // luma lines, so the chroma offsets are best asked of gralloc. Buffers it
+  // can not lock, protected video above all, get the format's layout.
+  GrallocYCbCrLayout ycbcr;
+  if (!GetGrallocYCbCrLayout(buffer, extent, &ycbcr) &&
+      !GetDefaultYCbCrLayout(info->layout, buffer, extent, &ycbcr))
+    return VK_ERROR_FORMAT_NOT_SUPPORTED;
+  if (!FitsDmaBuf(buffer, extent, ycbcr))
+    return VK_ERROR_FORMAT_NOT_SUPPORTED;
+
+  *layout = {};
+  layout->planes[0].rowPitch = ycbcr.lumaPitch;
+  switch (info->layout) {
+    case kLayoutNV12:
+      if (ycbcr.chromaStep != 2 || ycbcr.crOffset != ycbcr.cbOffset + 1) {
+        ALOGE("%s: gralloc format 0x%x is not laid out as CbCr", __func__,
+              buffer->format);
+        return VK_ERROR_FORMAT_NOT_SUPPORTED;
+      }
+      layout->planeCount = 2;
+      layout->planes[1].offset = ycbcr.cbOffset;
+      layout->planes[1].rowPitch = ycbcr.chromaPitch;
+      break;
+    case kLayoutYV12:
+      if (ycbcr.chromaStep != 1) {
+        ALOGE("%s: gralloc format 0x%x has interleaved chroma", __func__,
+              buffer->format);
+        return VK_ERROR_FORMAT_NOT_SUPPORTED;
+      }
+      // Vulkan orders the planes Y, Cb, Cr whatever order they are stored in
+      layout->planeCount = 3;
+      layout->planes[1].offset = ycbcr.cbOffset;
+      layout->planes[1].rowPitch = ycbcr.chromaPitch;
+      layout->planes[2].offset = ycbcr.crOffset;
+      layout->planes[2].rowPitch = ycbcr.chromaPitch;
+      break;
+  }
+
+  return VK_SUCCESS;
+}
+}
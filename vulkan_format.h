@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_FORMAT_H
+#define VULKAN_FORMAT_H
+
+#define VK_NO_PROTOTYPES 1
+#include <vulkan/vulkan.h>
+#include <vulkan/vk_android_native_buffer.h>
+
+namespace vulkan_hal {
+
+// Properties of a format the dma-buf import handles.
+struct FormatInfo {
+  VkFormat format;
+  uint32_t bytesPerPixel;
+  // the display engine can scan buffers of this format out of an overlay
+  // plane
+  bool scanout;
+};
+
+// Returns the properties of format, or NULL if it can not be imported.
+const FormatInfo* FindFormatInfo(VkFormat format);
+
+// Memory layout of a gralloc buffer as passed to vkCreateDmaBufImageINTEL.
+struct DmaBufLayout {
+  uint32_t bytesPerPixel;
+  uint32_t strideInBytes;
+};
+
+// Computes the layout of buffer when imported as an image of format with
+// the DRM format modifier. The row pitch comes from gralloc's stride, which
+// is in pixels of the buffer's own format. Fails with
+// VK_ERROR_FORMAT_NOT_SUPPORTED for formats the import can not handle or
+// that disagree with the buffer's pixel size, and for X tiled buffers whose
+// rows do not span whole X tiles.
+VkResult GetDmaBufLayout(VkFormat format,
+                         uint64_t modifier,
+                         const VkNativeBufferANDROID* buffer,
+                         DmaBufLayout* layout);
+
+const uint32_t kMaxDmaBufPlanes = 3;
+
+// Whether format is a multi-planar YUV format, see GetDmaBufPlanarLayout.
+bool IsPlanarFormat(VkFormat format);
+
+// Memory layout of a gralloc buffer as passed to an explicit modifier
+// import, with one plane per plane of the Vulkan format in its order. All
+// planes live in the buffer's first dma-buf.
+struct DmaBufPlanarLayout {
+  uint32_t planeCount;
+  VkSubresourceLayout planes[kMaxDmaBufPlanes];
+};
+
+// Computes the plane layout of buffer when imported as an image of format
+// and extent, with the plane offsets and pitches gralloc reports for it,
+// see GetGrallocYCbCrLayout, or for buffers gralloc can not lock the layout
+// the format defines. Fails with VK_ERROR_FORMAT_NOT_SUPPORTED for
+// combinations of formats the import can not handle, when the layout does
+// not match the format's and when the planes do not fit the dma-buf. The
+// handle has to have a dma-buf.
+VkResult GetDmaBufPlanarLayout(VkFormat format,
+                               const VkExtent3D& extent,
+                               const VkNativeBufferANDROID* buffer,
+                               DmaBufPlanarLayout* layout);
+}
+
+#endif
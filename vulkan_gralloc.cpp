@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <cutils/log.h>
+#include <cutils/properties.h>
+#include <hardware/gralloc.h>
+#include <system/graphics.h>
+
+#include "vulkan_gralloc.h"
+
+namespace vulkan_hal {
+
+namespace {
+
+pthread_once_t grallocOnce = PTHREAD_ONCE_INIT;
+const gralloc_module_t* loadedGralloc = nullptr;
+
+void LoadGralloc() {
+  const hw_module_t* module;
+  if (hw_get_module(GRALLOC_HARDWARE_MODULE_ID, &module) != 0) {
+    ALOGE("%s: failed to load gralloc", __func__);
+    return;
+  }
+  loadedGralloc = reinterpret_cast<const gralloc_module_t*>(module);
+}
+
+const gralloc_module_t* GetGralloc() {
+  pthread_once(&grallocOnce, LoadGralloc);
+  return loadedGralloc;
+}
+
+pthread_once_t heightAlignmentOnce = PTHREAD_ONCE_INIT;
+uint32_t heightAlignment = 1;
+
+void LoadHeightAlignment() {
+  char value[PROPERTY_VALUE_MAX];
+  property_get("ro.vulkan_hal.gralloc_yuv_height_align", value, "1");
+  const unsigned long alignment = strtoul(value, nullptr, 0);
+  if (alignment == 0 || alignment > 256) {
+    ALOGW("%s: ignoring YUV height alignment %s", __func__, value);
+    return;
+  }
+  heightAlignment = static_cast<uint32_t>(alignment);
+}
+
+VkDeviceSize Distance(const void* from, const void* to) {
+  return reinterpret_cast<uintptr_t>(to) - reinterpret_cast<uintptr_t>(from);
+}
+
+}  // namespace
+
+bool GetGrallocYCbCrLayout(const VkNativeBufferANDROID* buffer,
+                           const VkExtent3D& extent,
+                           GrallocYCbCrLayout* layout) {
+  // locking these fails, and gralloc may log loudly about it
+  if ((buffer->usage & GRALLOC_USAGE_PROTECTED) ||
+      !(buffer->usage & GRALLOC_USAGE_SW_READ_MASK))
+    return false;
+
+  const gralloc_module_t* grallocModule = GetGralloc();
+  if (!grallocModule || !grallocModule->lock_ycbcr)
+    return false;
+
+  struct android_ycbcr ycbcr = {};
+  if (grallocModule->lock_ycbcr(grallocModule, buffer->handle,
+                                GRALLOC_USAGE_SW_READ_RARELY, 0, 0,
+                                static_cast<int>(extent.width),
+                                static_cast<int>(extent.height),
+                                &ycbcr) != 0) {
+    ALOGW("%s: failed to lock buffer for its plane layout", __func__);
+    return false;
+  }
+  grallocModule->unlock(grallocModule, buffer->handle);
+
+  if (ycbcr.cb < ycbcr.y || ycbcr.cr < ycbcr.y) {
+    ALOGE("%s: chroma planes ahead of the luma plane", __func__);
+    return false;
+  }
+  layout->cbOffset = Distance(ycbcr.y, ycbcr.cb);
+  layout->crOffset = Distance(ycbcr.y, ycbcr.cr);
+  layout->lumaPitch = ycbcr.ystride;
+  layout->chromaPitch = ycbcr.cstride;
+  layout->chromaStep = static_cast<uint32_t>(ycbcr.chroma_step);
+  return true;
+}
+
+bool RegisterGrallocBuffer(buffer_handle_t handle) {
+  const gralloc_module_t* grallocModule = GetGralloc();
+  return grallocModule && grallocModule->registerBuffer &&
+         grallocModule->registerBuffer(grallocModule, handle) == 0;
+}
+
+void UnregisterGrallocBuffer(buffer_handle_t handle) {
+  const gralloc_module_t* grallocModule = GetGralloc();
+  if (grallocModule && grallocModule->unregisterBuffer)
+    grallocModule->unregisterBuffer(grallocModule, handle);
+}
+
+uint32_t GetGrallocYuvHeightAlignment() {
+  pthread_once(&heightAlignmentOnce, LoadHeightAlignment);
+  return heightAlignment;
+}
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_GRALLOC_H
+#define VULKAN_GRALLOC_H
+
+#include <stdint.h>
+
+#define VK_NO_PROTOTYPES 1
+#include <vulkan/vulkan.h>
+#include <vulkan/vk_android_native_buffer.h>
+
+namespace vulkan_hal {
+
+// Plane layout of a YUV gralloc buffer as gralloc's lock_ycbcr reports it.
+// Offsets are in bytes from the luma plane, which gralloc places at the
+// start of the buffer's first dma-buf.
+struct GrallocYCbCrLayout {
+  VkDeviceSize cbOffset;
+  VkDeviceSize crOffset;
+  VkDeviceSize lumaPitch;
+  VkDeviceSize chromaPitch;
+  // distance in bytes between two chroma samples of a plane, 2 where Cb
+  // and Cr are interleaved
+  uint32_t chromaStep;
+};
+
+// Queries the layout of buffer by locking the extent of it for CPU reads
+// and unlocking it right away. Returns false without trying for buffers
+// that can not be locked, protected ones and those allocated without CPU
+// read usage, and when the lock fails. The handle has to be registered
+// with gralloc in this process.
+bool GetGrallocYCbCrLayout(const VkNativeBufferANDROID* buffer,
+                           const VkExtent3D& extent,
+                           GrallocYCbCrLayout* layout);
+
+// Registers a handle the HAL cloned with gralloc, so that it can be locked
+// like the platform's own. Returns false if gralloc refuses it.
+bool RegisterGrallocBuffer(buffer_handle_t handle);
+void UnregisterGrallocBuffer(buffer_handle_t handle);
+
+// The number of lines gralloc aligns the luma plane of a YUV buffer to,
+// set with ro.vulkan_hal.gralloc_yuv_height_align. 1, the heights exactly
+// as allocated, unless the property says otherwise. Only used for buffers
+// whose layout GetGrallocYCbCrLayout can not query.
+uint32_t GetGrallocYuvHeightAlignment();
+}
+
+#endif
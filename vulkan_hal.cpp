@@ -20,153 +20,856 @@
 #include <hardware/gralloc.h>
 #include <vulkan/vk_android_native_buffer.h>
 #include <sync/sync.h>
-
+#include <pthread.h>
+
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "vulkan_acquire.h"
+#include "vulkan_arena.h"
+#include "vulkan_chain.h"
+#include "vulkan_device.h"
+#include "vulkan_extensions.h"
+#include "vulkan_fence.h"
+#include "vulkan_hal_ext.h"
+#include "vulkan_image_cache.h"
+#include "vulkan_image_ring.h"
+#include "vulkan_import.h"
+#include "vulkan_instance.h"
+#include "vulkan_proc_cache.h"
+#include "vulkan_stats.h"
+#include "vulkan_timing.h"
+#include "vulkan_usage.h"
 #include "vulkan_wrapper.h"
 #include "vulkan/vulkan_intel.h"
 
-static VkResult GetSwapchainGrallocUsageANDROID(VkDevice /*dev*/,
-                                                VkFormat /*fmt*/,
+static VkResult GetSwapchainGrallocUsageANDROID(VkDevice device,
+                                                VkFormat fmt,
                                                 VkImageUsageFlags usage,
                                                 int* grallocUsage) {
-  VkImageUsageFlags usageSrc =
-      VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT |
-      VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+  vulkan_hal::DeviceContext* ctx = vulkan_hal::GetDeviceContext(device);
+  return vulkan_hal::GetSwapchainGrallocUsage(ctx, fmt, usage, grallocUsage);
+}
 
-  VkImageUsageFlags usageDst =
-      VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+static VkResult GetSwapchainGrallocUsage2ANDROID(
+    VkDevice device,
+    VkFormat fmt,
+    VkImageUsageFlags usage,
+    VkSwapchainImageUsageFlagsANDROID swapchainImageUsage,
+    uint64_t* grallocConsumerUsage,
+    uint64_t* grallocProducerUsage) {
+  vulkan_hal::DeviceContext* ctx = vulkan_hal::GetDeviceContext(device);
+  return vulkan_hal::GetSwapchainGrallocUsage2(
+      ctx, fmt, usage, swapchainImageUsage, grallocConsumerUsage,
+      grallocProducerUsage);
+}
+static_assert(std::is_same<decltype(&GetSwapchainGrallocUsage2ANDROID),
+                           PFN_vkGetSwapchainGrallocUsage2ANDROID>::value,
+              "vk_android_native_buffer.h predates the gralloc1 usage split");
+
+// Shared presentable images are presented again and again without being
+// re-acquired. Demand refresh needs a release fence of its own for each
+// present, a driver that can not export sync_files would have to idle the
+// queue on every one. Continuous refresh only needs the image to be left X
+// tiled, see GetSwapchainGrallocUsage2.
+static bool SupportsSharedPresent(VkPhysicalDevice physicalDevice,
+                                  const vulkan_hal::InstanceProcs& procs) {
+  if (!procs.getPhysicalDeviceExternalSemaphoreProperties)
+    return false;
+
+  const VkPhysicalDeviceExternalSemaphoreInfoKHR info = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_SEMAPHORE_INFO_KHR,
+      .pNext = NULL,
+      .handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT_KHR,
+  };
+  VkExternalSemaphorePropertiesKHR properties = {
+      .sType = VK_STRUCTURE_TYPE_EXTERNAL_SEMAPHORE_PROPERTIES_KHR,
+      .pNext = NULL,
+      .exportFromImportedHandleTypes = 0,
+      .compatibleHandleTypes = 0,
+      .externalSemaphoreFeatures = 0,
+  };
+  procs.getPhysicalDeviceExternalSemaphoreProperties(physicalDevice, &info,
+                                                     &properties);
+  return (properties.externalSemaphoreFeatures &
+          VK_EXTERNAL_SEMAPHORE_FEATURE_EXPORTABLE_BIT_KHR) != 0;
+}
 
-  // used for texturing
-  if (usage & usageSrc)
-    *grallocUsage |= GRALLOC_USAGE_HW_TEXTURE;
+// The platform only offers VK_KHR_shared_presentable_image when the driver
+// reports support for shared images here. Mesa skips the Android structure
+// in the chain, fill it in after it is done.
+static void FillPresentationProperties(
+    VkPhysicalDevice physicalDevice,
+    const vulkan_hal::InstanceProcs& procs,
+    VkPhysicalDeviceProperties2KHR* pProperties) {
+  vulkan_hal::ChainIndex chain;
+  vulkan_hal::IndexChain(pProperties->pNext, &chain);
+  VkPhysicalDevicePresentationPropertiesANDROID* presentation =
+      vulkan_hal::GetOutputChainStruct<
+          VkPhysicalDevicePresentationPropertiesANDROID>(
+          chain, vulkan_hal::kChainPresentationProperties);
+  if (presentation)
+    presentation->sharedImage =
+        SupportsSharedPresent(physicalDevice, procs) ? VK_TRUE : VK_FALSE;
+}
 
-  // used for rendering
-  if (usage & usageDst)
-    *grallocUsage |= GRALLOC_USAGE_HW_RENDER;
+// The Vulkan 1.1 name, which a 1.1 instance has without the extension.
+static void GetPhysicalDeviceProperties2(
+    VkPhysicalDevice physicalDevice,
+    VkPhysicalDeviceProperties2KHR* pProperties) {
+  vulkan_hal::InstanceProcs procs;
+  if (!vulkan_hal::GetPhysicalDeviceProcs(physicalDevice, &procs) ||
+      !procs.getPhysicalDeviceProperties2) {
+    ALOGE("%s: physical device of an unknown instance", __func__);
+    return;
+  }
+  procs.getPhysicalDeviceProperties2(physicalDevice, pProperties);
+  FillPresentationProperties(physicalDevice, procs, pProperties);
+}
 
-  return VK_SUCCESS;
+static void GetPhysicalDeviceProperties2KHR(
+    VkPhysicalDevice physicalDevice,
+    VkPhysicalDeviceProperties2KHR* pProperties) {
+  vulkan_hal::InstanceProcs procs;
+  if (!vulkan_hal::GetPhysicalDeviceProcs(physicalDevice, &procs) ||
+      !procs.getPhysicalDeviceProperties2KHR) {
+    ALOGE("%s: physical device of an unknown instance", __func__);
+    return;
+  }
+  procs.getPhysicalDeviceProperties2KHR(physicalDevice, pProperties);
+  FillPresentationProperties(physicalDevice, procs, pProperties);
 }
 
-static VkResult AcquireImageANDROID(VkDevice, VkImage /*dev*/,
+// Hands the acquire fence of image to semaphore and fence, for both the
+// platform's acquire and one out of the image ring.
+static VkResult AcquireWithFence(vulkan_hal::DeviceContext* ctx,
+                                 VkImage image,
+                                 vulkan_hal::FenceFd nativeFence,
+                                 VkSemaphore semaphore,
+                                 VkFence fence) {
+  vulkan_hal::AcquireStrategy strategy = vulkan_hal::GetAcquireStrategy();
+  vulkan_hal::RecordAcquireTiming(ctx, image, nativeFence);
+
+  // The deferred strategy only needs import support for fences, a deferred
+  // semaphore fence is waited for at submission time without it. Otherwise
+  // fall back to waiting for the fence to signal before acquiring the image.
+  bool defer = strategy == vulkan_hal::kAcquireDeferred &&
+               semaphore != VK_NULL_HANDLE;
+  if (strategy == vulkan_hal::kAcquireBlocking ||
+      (semaphore != VK_NULL_HANDLE && !ctx->importSemaphoreFd && !defer) ||
+      (fence != VK_NULL_HANDLE && !ctx->importFenceFd)) {
+    nativeFence.Wait();
+    return VK_SUCCESS;
+  }
+
+  if (semaphore == VK_NULL_HANDLE && fence == VK_NULL_HANDLE)
+    return VK_SUCCESS;
+
+  // A fence that has already signaled, common when the compositor runs
+  // ahead, is imported as -1, which spares the driver the sync_file and this
+  // function the dup when both a semaphore and a fence are given. A deferred
+  // fence is only polled at submission, when it is more likely to have
+  // signaled.
+  if (!defer || fence != VK_NULL_HANDLE)
+    nativeFence.PollSignaled();
+
+  vulkan_hal::FenceFd semaphoreFd;
+  vulkan_hal::FenceFd fenceFd;
+  if (semaphore != VK_NULL_HANDLE && fence != VK_NULL_HANDLE &&
+      nativeFence.Get() >= 0) {
+    fenceFd.Reset(dup(nativeFence.Get()));
+    if (fenceFd.Get() < 0) {
+      // logging may clobber errno
+      const int error = errno;
+      ALOGE("%s: failed to dup native fence fd: %d", __func__, error);
+      return error == EMFILE ? VK_ERROR_TOO_MANY_OBJECTS
+                             : VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+  }
+  if (semaphore != VK_NULL_HANDLE)
+    semaphoreFd = std::move(nativeFence);
+  else
+    fenceFd = std::move(nativeFence);
+
+  VkResult result = VK_SUCCESS;
+
+  if (defer) {
+    result =
+        vulkan_hal::DeferAcquireFence(ctx, semaphore, std::move(semaphoreFd));
+  } else if (semaphore != VK_NULL_HANDLE) {
+    const VkImportSemaphoreFdInfoKHR info = {
+        .sType = VK_STRUCTURE_TYPE_IMPORT_SEMAPHORE_FD_INFO_KHR,
+        .pNext = NULL,
+        .semaphore = semaphore,
+        .flags = VK_SEMAPHORE_IMPORT_TEMPORARY_BIT_KHR,
+        .handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT_KHR,
+        .fd = semaphoreFd.Get(),
+    };
+    result = ctx->importSemaphoreFd(ctx->device, &info);
+    if (result == VK_SUCCESS)
+      semaphoreFd.Release();
+    else
+      ALOGE("%s: failed to import acquire fence into semaphore", __func__);
+  }
+
+  if (result == VK_SUCCESS && fence != VK_NULL_HANDLE) {
+    const VkImportFenceFdInfoKHR info = {
+        .sType = VK_STRUCTURE_TYPE_IMPORT_FENCE_FD_INFO_KHR,
+        .pNext = NULL,
+        .fence = fence,
+        .flags = VK_FENCE_IMPORT_TEMPORARY_BIT_KHR,
+        .handleType = VK_EXTERNAL_FENCE_HANDLE_TYPE_SYNC_FD_BIT_KHR,
+        .fd = fenceFd.Get(),
+    };
+    result = ctx->importFenceFd(ctx->device, &info);
+    if (result == VK_SUCCESS)
+      fenceFd.Release();
+    else
+      ALOGE("%s: failed to import acquire fence into fence", __func__);
+  }
+
+  return result;
+}
+
+static VkResult AcquireImageANDROID(VkDevice device,
+                                    VkImage image,
                                     int nativeFenceFd,
-                                    VkSemaphore /*semaphore*/,
-                                    VkFence /*fence*/) {
-  // wait for fence to signal before acquiring image
-  sync_wait(nativeFenceFd, -1);
+                                    VkSemaphore semaphore,
+                                    VkFence fence) {
+  vulkan_hal::ScopedStat stat(vulkan_hal::kStatAcquire, __func__);
+  vulkan_hal::DeviceContext* ctx = vulkan_hal::GetDeviceContext(device);
+  // The driver owns nativeFenceFd and has to close it even on failure, while
+  // a successful sync_file import transfers ownership to Mesa.
+  vulkan_hal::FenceFd nativeFence(nativeFenceFd);
+  if (vulkan_hal::ImageRingActive(ctx))
+    vulkan_hal::SetRingState(ctx, image, vulkan_hal::kRingAcquired);
+  return AcquireWithFence(ctx, image, std::move(nativeFence), semaphore,
+                          fence);
+}
+
+static VkResult HalQueueNativeBufferFence(VkDevice device,
+                                          VkImage image,
+                                          int nativeFenceFd) {
+  vulkan_hal::DeviceContext* ctx = vulkan_hal::GetDeviceContext(device);
+  return vulkan_hal::QueueRingFence(ctx, image,
+                                    vulkan_hal::FenceFd(nativeFenceFd));
+}
+static_assert(std::is_same<decltype(&HalQueueNativeBufferFence),
+                           PFN_vkHalQueueNativeBufferFence>::value,
+              "vkHalQueueNativeBufferFence does not match vulkan_hal_ext.h");
+
+static VkResult HalAcquireQueuedImage(VkDevice device,
+                                      uint32_t imageCount,
+                                      const VkImage* pImages,
+                                      uint64_t timeout,
+                                      VkSemaphore semaphore,
+                                      VkFence fence,
+                                      uint32_t* pImageIndex) {
+  vulkan_hal::ScopedStat stat(vulkan_hal::kStatAcquire, __func__);
+  vulkan_hal::DeviceContext* ctx = vulkan_hal::GetDeviceContext(device);
+  vulkan_hal::FenceFd nativeFence;
+  VkResult result = vulkan_hal::TakeRingImage(
+      ctx, imageCount, pImages, timeout, pImageIndex, &nativeFence);
+  if (result != VK_SUCCESS)
+    return result;
+  return AcquireWithFence(ctx, pImages[*pImageIndex], std::move(nativeFence),
+                          semaphore, fence);
+}
+static_assert(std::is_same<decltype(&HalAcquireQueuedImage),
+                           PFN_vkHalAcquireQueuedImage>::value,
+              "vkHalAcquireQueuedImage does not match vulkan_hal_ext.h");
+
+// Returns the context of the device of queue, or NULL if the queue was not
+// retrieved through vkGetDeviceQueue. One scan of the device slots under a
+// loader, the queues of every device otherwise.
+static vulkan_hal::DeviceContext* GetQueueContext(VkQueue queue) {
+  vulkan_hal::DeviceContext* ctx = vulkan_hal::GetDispatchContext(queue);
+  if (ctx)
+    return ctx;
+  vulkan_hal::QueueState* state = vulkan_hal::GetQueueState(queue);
+  return state ? state->ctx : nullptr;
+}
+
+static VkResult CreateDevice(VkPhysicalDevice physicalDevice,
+                             const VkDeviceCreateInfo* pCreateInfo,
+                             const VkAllocationCallbacks* pAllocator,
+                             VkDevice* pDevice) {
+  vulkan_hal::InstanceProcs procs;
+  if (!vulkan_hal::GetPhysicalDeviceProcs(physicalDevice, &procs)) {
+    ALOGE("%s: physical device of an unknown instance", __func__);
+    return VK_ERROR_INITIALIZATION_FAILED;
+  }
+
+  VkResult result =
+      procs.createDevice(physicalDevice, pCreateInfo, pAllocator, pDevice);
+  if (result != VK_SUCCESS)
+    return result;
+
+  result = vulkan_hal::RegisterDevice(physicalDevice, pCreateInfo, *pDevice,
+                                      pAllocator);
+  if (result != VK_SUCCESS) {
+    PFN_vkDestroyDevice destroyDevice = reinterpret_cast<PFN_vkDestroyDevice>(
+        mesa_vulkan::vkGetDeviceProcAddr(*pDevice, "vkDestroyDevice"));
+    destroyDevice(*pDevice, pAllocator);
+    *pDevice = VK_NULL_HANDLE;
+  }
+
+  return result;
+}
+
+static void GetDeviceQueue(VkDevice device,
+                           uint32_t queueFamilyIndex,
+                           uint32_t queueIndex,
+                           VkQueue* pQueue) {
+  vulkan_hal::DeviceContext* ctx = vulkan_hal::GetDeviceContext(device);
+  ctx->getDeviceQueue(device, queueFamilyIndex, queueIndex, pQueue);
+
+  // the loader has set up the device by now, its queues get the same
+  // dispatch pointer
+  vulkan_hal::BindDeviceDispatch(ctx);
+
+  vulkan_hal::RegisterQueue(ctx, *pQueue);
+}
+
+static void DestroyDevice(VkDevice device,
+                          const VkAllocationCallbacks* pAllocator) {
+  if (device == VK_NULL_HANDLE)
+    return;
+
+  vulkan_hal::DeviceContext* ctx = vulkan_hal::GetDeviceContext(device);
+  vulkan_hal::DumpImageCacheStats(ctx);
+
+  PFN_vkDestroyDevice destroyDevice = ctx->destroyDevice;
+  vulkan_hal::UnregisterDevice(ctx);
+  destroyDevice(device, pAllocator);
+
+  vulkan_hal::DumpStats();
+}
+
+// Fallback for drivers without sync_file export, -1 is only a correct
+// release fence once the queue has drained.
+static VkResult WaitReleaseSemaphores(vulkan_hal::QueueState* state,
+                                      const VkSubmitInfo* submit,
+                                      int* pNativeFenceFd) {
+  VkResult result =
+      state->ctx->queueSubmit(state->queue, 1, submit, VK_NULL_HANDLE);
+  if (result == VK_SUCCESS)
+    result = state->ctx->queueWaitIdle(state->queue);
+  *pNativeFenceFd = -1;
+  return result;
+}
+
+// Queues the release of an image on the queue of state, NULL for a queue
+// not retrieved through vkGetDeviceQueue. The caller owns the fence
+// returned in pNativeFenceFd. *pSubmitted tells whether the release went
+// through the GPU, rather than being ready right away or made up of the
+// acquire fences.
+static VkResult SignalReleaseImage(vulkan_hal::QueueState* state,
+                                   uint32_t waitSemaphoreCount,
+                                   const VkSemaphore* pWaitSemaphores,
+                                   int* pNativeFenceFd,
+                                   bool* pSubmitted) {
+  *pNativeFenceFd = -1;
+  *pSubmitted = false;
+
+  // nothing to wait for, the image is ready as soon as it is queued
+  if (waitSemaphoreCount == 0)
+    return VK_SUCCESS;
+
+  if (!state) {
+    ALOGE("%s: queue was not retrieved through vkGetDeviceQueue", __func__);
+    return VK_ERROR_INITIALIZATION_FAILED;
+  }
+
+  const uint32_t kInlineWaitCount = 8;
+  VkPipelineStageFlags inlineStages[kInlineWaitCount];
+  std::vector<VkPipelineStageFlags> heapStages;
+  VkPipelineStageFlags* waitStages = inlineStages;
+  if (waitSemaphoreCount > kInlineWaitCount) {
+    heapStages.resize(waitSemaphoreCount);
+    waitStages = heapStages.data();
+  }
+  for (uint32_t i = 0; i < waitSemaphoreCount; i++)
+    waitStages[i] = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+  VkSubmitInfo submit = {
+      .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+      .pNext = NULL,
+      .waitSemaphoreCount = waitSemaphoreCount,
+      .pWaitSemaphores = pWaitSemaphores,
+      .pWaitDstStageMask = waitStages,
+      .commandBufferCount = 0,
+      .pCommandBuffers = NULL,
+      .signalSemaphoreCount = 0,
+      .pSignalSemaphores = NULL,
+  };
+
+  vulkan_hal::DeviceContext* ctx = state->ctx;
+
+  // An image presented straight from its acquire semaphores, like one that
+  // is only composed by the platform, needs no submission under the deferred
+  // strategy: the release fence is the merge of the acquire fences.
+  vulkan_hal::FenceFd inlineFences[kInlineWaitCount];
+  std::vector<vulkan_hal::FenceFd> heapFences;
+  vulkan_hal::FenceFd* acquireFences = inlineFences;
+  if (waitSemaphoreCount > kInlineWaitCount) {
+    heapFences.resize(waitSemaphoreCount);
+    acquireFences = heapFences.data();
+  }
+  if (vulkan_hal::TakeDeferredAcquires(ctx, waitSemaphoreCount,
+                                       pWaitSemaphores, acquireFences)) {
+    *pNativeFenceFd =
+        vulkan_hal::MergeFences(acquireFences, waitSemaphoreCount).Release();
+    return VK_SUCCESS;
+  }
+
+  // presenting straight from the acquire semaphore is allowed
+  VkResult result = vulkan_hal::ResolveDeferredAcquires(
+      ctx, waitSemaphoreCount, pWaitSemaphores);
+  if (result != VK_SUCCESS)
+    return result;
+  *pSubmitted = true;
+
+  if (!ctx->getSemaphoreFd)
+    return WaitReleaseSemaphores(state, &submit, pNativeFenceFd);
+
+  if (state->releaseSemaphore == VK_NULL_HANDLE) {
+    const VkExportSemaphoreCreateInfoKHR exportInfo = {
+        .sType = VK_STRUCTURE_TYPE_EXPORT_SEMAPHORE_CREATE_INFO_KHR,
+        .pNext = NULL,
+        .handleTypes = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT_KHR,
+    };
+    const VkSemaphoreCreateInfo createInfo = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        .pNext = &exportInfo,
+        .flags = 0,
+    };
+    if (ctx->createSemaphore(ctx->device, &createInfo, NULL,
+                             &state->releaseSemaphore) != VK_SUCCESS) {
+      ALOGW("%s: no exportable semaphore, waiting for queue idle", __func__);
+      state->releaseSemaphore = VK_NULL_HANDLE;
+      return WaitReleaseSemaphores(state, &submit, pNativeFenceFd);
+    }
+  }
+
+  submit.signalSemaphoreCount = 1;
+  submit.pSignalSemaphores = &state->releaseSemaphore;
+
+  result = ctx->queueSubmit(state->queue, 1, &submit, VK_NULL_HANDLE);
+  if (result != VK_SUCCESS)
+    return result;
+
+  // Exporting a sync_file unsignals the semaphore again, so the same one is
+  // reused for every present on this queue. Each present gets a fence of its
+  // own, which is also what a shared image in demand or continuous refresh
+  // mode relies on as it is presented again without being re-acquired.
+  const VkSemaphoreGetFdInfoKHR getFdInfo = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_GET_FD_INFO_KHR,
+      .pNext = NULL,
+      .semaphore = state->releaseSemaphore,
+      .handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT_KHR,
+  };
+  result = ctx->getSemaphoreFd(ctx->device, &getFdInfo, pNativeFenceFd);
+  if (result != VK_SUCCESS) {
+    ALOGE("%s: failed to export release fence", __func__);
+    *pNativeFenceFd = -1;
+    return result;
+  }
 
-  close(nativeFenceFd);
   return VK_SUCCESS;
 }
 
-static VkResult QueueSignalReleaseImageANDROID(VkQueue /*queue*/,
-                                               uint32_t /*waitSemaphoreCount*/,
-                                               const VkSemaphore* /*pWaitSemaphores */,
-                                               VkImage /*image*/,
+static VkResult QueueSignalReleaseImageANDROID(VkQueue queue,
+                                               uint32_t waitSemaphoreCount,
+                                               const VkSemaphore* pWaitSemaphores,
+                                               VkImage image,
                                                int* pNativeFenceFd) {
+  vulkan_hal::ScopedStat stat(vulkan_hal::kStatRelease, __func__);
   if (pNativeFenceFd)
     *pNativeFenceFd = -1;
+
+  // the one lookup of the present, by the loader dispatch pointer
+  vulkan_hal::QueueState* state = vulkan_hal::GetQueueState(queue);
+  int fd;
+  bool submitted;
+  VkResult result = SignalReleaseImage(state, waitSemaphoreCount,
+                                       pWaitSemaphores, &fd, &submitted);
+  vulkan_hal::FenceFd releaseFence(fd);
+  if (result != VK_SUCCESS)
+    return result;
+
+  vulkan_hal::DeviceContext* ctx = state ? state->ctx : nullptr;
+  if (ctx)
+    vulkan_hal::RecordReleaseTiming(ctx, image, releaseFence.Get(),
+                                    submitted);
+  if (ctx && vulkan_hal::ImageRingActive(ctx))
+    vulkan_hal::SetRingState(ctx, image, vulkan_hal::kRingReleased);
+
+  if (pNativeFenceFd)
+    *pNativeFenceFd = releaseFence.Release();
   return VK_SUCCESS;
 }
 
-static VkResult CreateImage(VkDevice device,
-                            const VkImageCreateInfo* pCreateInfo,
-                            const VkAllocationCallbacks* pAllocator,
-                            VkImage* pImage) {
-  static PFN_vkCreateDmaBufImageINTEL dmabufFunc =
-      reinterpret_cast<PFN_vkCreateDmaBufImageINTEL>(
-          mesa_vulkan::vkGetDeviceProcAddr(device, "vkCreateDmaBufImageINTEL"));
+// Only handed out with the deferred acquire strategy, see
+// AcquireImageANDROID.
+static VkResult QueueSubmit(VkQueue queue,
+                            uint32_t submitCount,
+                            const VkSubmitInfo* pSubmits,
+                            VkFence fence) {
+  vulkan_hal::DeviceContext* ctx = GetQueueContext(queue);
+  if (!ctx) {
+    ALOGE("%s: queue was not retrieved through vkGetDeviceQueue", __func__);
+    return VK_ERROR_INITIALIZATION_FAILED;
+  }
+
+  for (uint32_t i = 0; i < submitCount; i++) {
+    VkResult result = vulkan_hal::ResolveDeferredAcquires(
+        ctx, pSubmits[i].waitSemaphoreCount, pSubmits[i].pWaitSemaphores);
+    if (result != VK_SUCCESS)
+      return result;
+  }
+
+  return ctx->queueSubmit(queue, submitCount, pSubmits, fence);
+}
+
+// Resolves the deferred fences the submissions wait on, for the core and
+// KHR vkQueueSubmit2 alike.
+static VkResult ResolveSubmit2Acquires(vulkan_hal::DeviceContext* ctx,
+                                       uint32_t submitCount,
+                                       const VkSubmitInfo2KHR* pSubmits) {
+  for (uint32_t i = 0; i < submitCount; i++) {
+    for (uint32_t j = 0; j < pSubmits[i].waitSemaphoreInfoCount; j++) {
+      VkResult result = vulkan_hal::ResolveDeferredAcquires(
+          ctx, 1, &pSubmits[i].pWaitSemaphoreInfos[j].semaphore);
+      if (result != VK_SUCCESS)
+        return result;
+    }
+  }
+  return VK_SUCCESS;
+}
 
-  if (!dmabufFunc || !pCreateInfo->pNext) {
-    ALOGE("ANDROID extension structure not found");
-    return VK_ERROR_EXTENSION_NOT_PRESENT;
+// Only handed out with the deferred acquire strategy, like QueueSubmit, and
+// only when the driver has the entry point.
+static VkResult QueueSubmit2(VkQueue queue,
+                             uint32_t submitCount,
+                             const VkSubmitInfo2KHR* pSubmits,
+                             VkFence fence) {
+  vulkan_hal::DeviceContext* ctx = GetQueueContext(queue);
+  if (!ctx) {
+    ALOGE("%s: queue was not retrieved through vkGetDeviceQueue", __func__);
+    return VK_ERROR_INITIALIZATION_FAILED;
   }
+  VkResult result = ResolveSubmit2Acquires(ctx, submitCount, pSubmits);
+  if (result != VK_SUCCESS)
+    return result;
+  return ctx->queueSubmit2(queue, submitCount, pSubmits, fence);
+}
 
-  const VkImageCreateInfo* p =
-      reinterpret_cast<const VkImageCreateInfo*>(pCreateInfo->pNext);
+static VkResult QueueSubmit2KHR(VkQueue queue,
+                                uint32_t submitCount,
+                                const VkSubmitInfo2KHR* pSubmits,
+                                VkFence fence) {
+  vulkan_hal::DeviceContext* ctx = GetQueueContext(queue);
+  if (!ctx) {
+    ALOGE("%s: queue was not retrieved through vkGetDeviceQueue", __func__);
+    return VK_ERROR_INITIALIZATION_FAILED;
+  }
+  VkResult result = ResolveSubmit2Acquires(ctx, submitCount, pSubmits);
+  if (result != VK_SUCCESS)
+    return result;
+  return ctx->queueSubmit2KHR(queue, submitCount, pSubmits, fence);
+}
 
-  // we hardcode VK_STRUCTURE_TYPE_NATIVE_BUFFER_ANDROID for now as
-  // vk_android_native_buffer.h is using old style cast
-  while (p && p->sType != 1000010000)
-    p = reinterpret_cast<const VkImageCreateInfo*>(p->pNext);
+// A sparse binding can wait on an acquire semaphore just as a submission.
+static VkResult QueueBindSparse(VkQueue queue,
+                                uint32_t bindInfoCount,
+                                const VkBindSparseInfo* pBindInfo,
+                                VkFence fence) {
+  vulkan_hal::DeviceContext* ctx = GetQueueContext(queue);
+  if (!ctx) {
+    ALOGE("%s: queue was not retrieved through vkGetDeviceQueue", __func__);
+    return VK_ERROR_INITIALIZATION_FAILED;
+  }
 
-  if (!p) {
-    ALOGE("VK_ANDROID_native_buffer extension structure not found");
-    return VK_ERROR_EXTENSION_NOT_PRESENT;
+  for (uint32_t i = 0; i < bindInfoCount; i++) {
+    VkResult result = vulkan_hal::ResolveDeferredAcquires(
+        ctx, pBindInfo[i].waitSemaphoreCount, pBindInfo[i].pWaitSemaphores);
+    if (result != VK_SUCCESS)
+      return result;
   }
 
+  return ctx->queueBindSparse(queue, bindInfoCount, pBindInfo, fence);
+}
+
+static void DestroySemaphore(VkDevice device,
+                             VkSemaphore semaphore,
+                             const VkAllocationCallbacks* pAllocator) {
+  vulkan_hal::DeviceContext* ctx = vulkan_hal::GetDeviceContext(device);
+  if (semaphore != VK_NULL_HANDLE)
+    vulkan_hal::DropDeferredAcquire(ctx, semaphore);
+  ctx->destroySemaphore(device, semaphore, pAllocator);
+}
+
+static VkResult CreateImage(VkDevice device,
+                            const VkImageCreateInfo* pCreateInfo,
+                            const VkAllocationCallbacks* pAllocator,
+                            VkImage* pImage) {
+  vulkan_hal::DeviceContext* ctx = vulkan_hal::GetDeviceContext(device);
+
+  vulkan_hal::ChainIndex chain;
+  vulkan_hal::IndexChain(pCreateInfo->pNext, &chain);
   const VkNativeBufferANDROID* buffer =
-      reinterpret_cast<const VkNativeBufferANDROID*>(pCreateInfo->pNext);
+      vulkan_hal::GetChainStruct<VkNativeBufferANDROID>(
+          chain, vulkan_hal::kChainNativeBuffer);
 
-  const native_handle_t* handle =
-      reinterpret_cast<const native_handle_t*>(buffer->handle);
+  // only swapchain images are backed by gralloc buffers, every other image
+  // is the driver's business
+  if (!buffer)
+    return ctx->createImage(device, pCreateInfo, pAllocator, pImage);
 
-  VkDeviceMemory pMem;
-  VkDmaBufImageCreateInfo dmabufInfo = {
-      .sType = static_cast<VkStructureType>(
-          VK_STRUCTURE_TYPE_DMA_BUF_IMAGE_CREATE_INFO_INTEL),
-      .pNext = NULL,
-      .fd = handle->data[0],
-      .format = pCreateInfo->format,
-      .extent = {
-          .width = pCreateInfo->extent.width,
-          .height = pCreateInfo->extent.height,
-          .depth = pCreateInfo->extent.depth,
-      },
-      // FIXME magic, we know this surface tiling to be I915_TILING_X and
-      // take this in to account when giving stride, Mesa will internally
-      // use this exact value as row pitch validation for the surface.
-      .strideInBytes = static_cast<uint32_t>(buffer->stride * 4),
-  };
+  return vulkan_hal::ImportNativeBuffer(ctx, *pCreateInfo, buffer, pAllocator,
+                                       true, pImage);
+}
 
-  return dmabufFunc(device, &dmabufInfo, pAllocator, &pMem, pImage);
+static VkResult HalPrepareNativeBuffers(VkDevice device,
+                                        const VkImageCreateInfo* pCreateInfo,
+                                        uint32_t bufferCount,
+                                        const VkNativeBufferANDROID* pBuffers,
+                                        VkBool32 async) {
+  vulkan_hal::DeviceContext* ctx = vulkan_hal::GetDeviceContext(device);
+  return vulkan_hal::PrepareNativeBuffers(ctx, pCreateInfo, bufferCount,
+                                          pBuffers, async == VK_TRUE);
+}
+static_assert(std::is_same<decltype(&HalPrepareNativeBuffers),
+                           PFN_vkHalPrepareNativeBuffers>::value,
+              "vkHalPrepareNativeBuffers does not match vulkan_hal_ext.h");
+
+static VkResult HalGetNativeBufferTiming(VkDevice device,
+                                         VkImage image,
+                                         VkHalNativeBufferTiming* pTiming) {
+  vulkan_hal::DeviceContext* ctx = vulkan_hal::GetDeviceContext(device);
+  return vulkan_hal::GetNativeBufferTiming(ctx, image, pTiming);
+}
+static_assert(std::is_same<decltype(&HalGetNativeBufferTiming),
+                           PFN_vkHalGetNativeBufferTiming>::value,
+              "vkHalGetNativeBufferTiming does not match vulkan_hal_ext.h");
+
+static void DestroyImage(VkDevice device,
+                         VkImage image,
+                         const VkAllocationCallbacks* pAllocator) {
+  vulkan_hal::DeviceContext* ctx = vulkan_hal::GetDeviceContext(device);
+
+  if (image == VK_NULL_HANDLE)
+    return;
+  vulkan_hal::DropPresentTiming(ctx, image);
+  if (vulkan_hal::ImageRingActive(ctx))
+    vulkan_hal::DropRingImage(ctx, image);
+  if (vulkan_hal::ReleaseCachedImage(ctx, image))
+    return;
+
+  ctx->destroyImage(device, image, pAllocator);
 }
 
-static int CloseDevice(struct hw_device_t* dev) {
+// dev is the statically allocated mesa_vulkan_device, nothing to free
+static int CloseDevice(struct hw_device_t* /*dev*/) {
+  vulkan_hal::DumpStats();
   mesa_vulkan::Close();
-  delete dev;
   return 0;
 }
 
 static VkResult EnumerateInstanceExtensionProperties(
     const char* layer_name, uint32_t* count,
     VkExtensionProperties* properties) {
-  return mesa_vulkan::vkEnumerateInstanceExtensionProperties(layer_name, count,
-                                                             properties);
+  return vulkan_hal::EnumerateInstanceExtensionProperties(layer_name, count,
+                                                         properties);
+}
+
+static PFN_vkVoidFunction GetDeviceProcAddr(VkDevice device, const char* name);
+static void DestroyInstance(VkInstance instance,
+                            const VkAllocationCallbacks* allocator);
+
+// Every entry point the HAL intercepts, as HOOK(type, function) where the
+// Vulkan name is "vk" followed by the name of the HAL function.
+//   kInstance:        returned from vkGetInstanceProcAddr
+//   kInstanceWrapper: returned from vkGetInstanceProcAddr in place of Mesa's,
+//                     only if Mesa has one to wrap
+//   kDevice:          returned from vkGetDeviceProcAddr in place of Mesa's
+//   kDeviceFallback:  returned from vkGetDeviceProcAddr if Mesa has none
+//   kDeviceDeferredAcquire:
+//                     returned from vkGetDeviceProcAddr in place of Mesa's
+//                     with the deferred acquire strategy only, if Mesa has
+//                     one; every queue operation that can wait on an
+//                     acquire semaphore has to be one
+#define HAL_PROC_HOOKS(HOOK)                               \
+  HOOK(kInstance, GetDeviceProcAddr)                       \
+  HOOK(kInstance, DestroyInstance)                         \
+  HOOK(kInstance, CreateDevice)                            \
+  HOOK(kInstanceWrapper, GetPhysicalDeviceProperties2)     \
+  HOOK(kInstanceWrapper, GetPhysicalDeviceProperties2KHR)  \
+  HOOK(kDevice, CreateImage)                               \
+  HOOK(kDevice, DestroyImage)                              \
+  HOOK(kDevice, GetDeviceQueue)                            \
+  HOOK(kDevice, DestroyDevice)                             \
+  HOOK(kDeviceFallback, GetSwapchainGrallocUsageANDROID)   \
+  HOOK(kDeviceFallback, GetSwapchainGrallocUsage2ANDROID)  \
+  HOOK(kDeviceFallback, AcquireImageANDROID)               \
+  HOOK(kDeviceFallback, QueueSignalReleaseImageANDROID)    \
+  HOOK(kDevice, HalPrepareNativeBuffers)                   \
+  HOOK(kDevice, HalGetNativeBufferTiming)                  \
+  HOOK(kDevice, HalQueueNativeBufferFence)                 \
+  HOOK(kDevice, HalAcquireQueuedImage)                     \
+  HOOK(kDeviceDeferredAcquire, QueueSubmit)                \
+  HOOK(kDeviceDeferredAcquire, QueueSubmit2)               \
+  HOOK(kDeviceDeferredAcquire, QueueSubmit2KHR)            \
+  HOOK(kDeviceDeferredAcquire, QueueBindSparse)            \
+  HOOK(kDeviceDeferredAcquire, DestroySemaphore)
+
+enum class ProcHookType {
+  kInstance,
+  kInstanceWrapper,
+  kDevice,
+  kDeviceFallback,
+  kDeviceDeferredAcquire
+};
+
+struct ProcHook {
+  const char* name;
+  ProcHookType type;
+  PFN_vkVoidFunction proc;
+};
+
+#define HAL_PROC_HOOK_NAME(type, func) "vk" #func,
+#define HAL_PROC_HOOK_ENTRY(type, func)                  \
+  {"vk" #func, ProcHookType::type,                       \
+   reinterpret_cast<PFN_vkVoidFunction>(func)},
+
+static constexpr const char* kProcHookNames[] = {
+    HAL_PROC_HOOKS(HAL_PROC_HOOK_NAME)};
+
+static const ProcHook kProcHooks[] = {HAL_PROC_HOOKS(HAL_PROC_HOOK_ENTRY)};
+
+#undef HAL_PROC_HOOK_NAME
+#undef HAL_PROC_HOOK_ENTRY
+
+static constexpr uint32_t kProcHookCount =
+    sizeof(kProcHookNames) / sizeof(kProcHookNames[0]);
+static_assert(kProcHookCount == sizeof(kProcHooks) / sizeof(kProcHooks[0]),
+              "proc hook tables out of sync");
+
+// The hook names are hashed into a power of two sized slot table. The hash
+// seed is searched for at compile time so that no two names share a slot,
+// which makes a lookup one hash of the name plus one strcmp.
+static constexpr uint32_t kProcHookSlotBits = 6;
+static constexpr uint32_t kProcHookSlotCount = 1u << kProcHookSlotBits;
+static constexpr uint8_t kNoProcHook = 0xff;
+static_assert(kProcHookCount < kNoProcHook, "too many proc hooks");
+static_assert(kProcHookCount * 2 <= kProcHookSlotCount,
+              "proc hook slot table too crowded");
+
+// The top bits of the hash: the low bits of an FNV-1a product only depend
+// on the low bits of the seed, so with them every seed past the slot count
+// would repeat an earlier one.
+static constexpr uint32_t ProcHookSlot(const char* name, uint32_t seed) {
+  return vulkan_hal::HashProcName(name, seed) >> (32 - kProcHookSlotBits);
+}
+
+// One hash per name and seed, a seed fails at its first collision.
+static_assert(kProcHookSlotCount <= 64, "slot mask too narrow");
+static constexpr bool IsPerfectProcHookSeed(uint32_t seed) {
+  uint64_t usedSlots = 0;
+  for (uint32_t i = 0; i < kProcHookCount; i++) {
+    const uint64_t slot = uint64_t(1)
+                          << ProcHookSlot(kProcHookNames[i], seed);
+    if (usedSlots & slot)
+      return false;
+    usedSlots |= slot;
+  }
+  return true;
+}
+
+static constexpr uint32_t kMaxProcHookSeed = 4096;
+
+static constexpr uint32_t FindProcHookSeed() {
+  uint32_t seed = 0;
+  while (seed < kMaxProcHookSeed && !IsPerfectProcHookSeed(seed))
+    seed++;
+  return seed;
+}
+
+struct ProcHookSlots {
+  uint32_t seed;
+  uint8_t index[kProcHookSlotCount];
+};
+
+static constexpr ProcHookSlots BuildProcHookSlots() {
+  ProcHookSlots slots = {FindProcHookSeed(), {}};
+  for (uint32_t i = 0; i < kProcHookSlotCount; i++)
+    slots.index[i] = kNoProcHook;
+  for (uint32_t i = 0; i < kProcHookCount; i++)
+    slots.index[ProcHookSlot(kProcHookNames[i], slots.seed)] =
+        static_cast<uint8_t>(i);
+  return slots;
+}
+
+static constexpr ProcHookSlots kProcHookSlots = BuildProcHookSlots();
+static_assert(kProcHookSlots.seed < kMaxProcHookSeed,
+              "no collision free seed for the proc hook names");
+
+static const ProcHook* FindProcHook(const char* name) {
+  uint8_t index = kProcHookSlots.index[ProcHookSlot(name, kProcHookSlots.seed)];
+  if (index == kNoProcHook || strcmp(kProcHooks[index].name, name) != 0)
+    return nullptr;
+  return &kProcHooks[index];
 }
 
 static PFN_vkVoidFunction GetDeviceProcAddr(VkDevice device, const char* name) {
-  PFN_vkVoidFunction pfn;
+  vulkan_hal::CountStat(vulkan_hal::kStatProcLookup);
+  const ProcHook* hook = FindProcHook(name);
 
-  /* wrap vkCreateImage to use vkCreateDmaBufImageINTEL */
-  if (strcmp(name, "vkCreateImage") == 0) {
-    return reinterpret_cast<PFN_vkVoidFunction>(CreateImage);
+  if (hook && hook->type == ProcHookType::kDevice) {
+    vulkan_hal::CountStat(vulkan_hal::kStatProcHook);
+    return hook->proc;
   }
 
+  PFN_vkVoidFunction pfn;
   if ((pfn = reinterpret_cast<PFN_vkVoidFunction>(
-           mesa_vulkan::vkGetDeviceProcAddr(device, name)))) {
+           vulkan_hal::GetDriverDeviceProcAddr(device, name)))) {
+    if (hook && hook->type == ProcHookType::kDeviceDeferredAcquire &&
+        vulkan_hal::GetAcquireStrategy() == vulkan_hal::kAcquireDeferred) {
+      vulkan_hal::CountStat(vulkan_hal::kStatProcHook);
+      return hook->proc;
+    }
     return pfn;
   }
 
-  if (strcmp(name, "vkGetSwapchainGrallocUsageANDROID") == 0)
-    return reinterpret_cast<PFN_vkVoidFunction>(GetSwapchainGrallocUsageANDROID);
-
-  if (strcmp(name, "vkAcquireImageANDROID") == 0)
-    return reinterpret_cast<PFN_vkVoidFunction>(AcquireImageANDROID);
-
-  if (strcmp(name, "vkQueueSignalReleaseImageANDROID") == 0)
-    return reinterpret_cast<PFN_vkVoidFunction>(QueueSignalReleaseImageANDROID);
+  if (hook && hook->type == ProcHookType::kDeviceFallback) {
+    vulkan_hal::CountStat(vulkan_hal::kStatProcHook);
+    return hook->proc;
+  }
 
   return nullptr;
 }
 
 static PFN_vkVoidFunction GetInstanceProcAddr(VkInstance instance,
                                               const char* name) {
-  PFN_vkVoidFunction pfn;
+  vulkan_hal::CountStat(vulkan_hal::kStatProcLookup);
+  const ProcHook* hook = FindProcHook(name);
+  if (hook && hook->type == ProcHookType::kInstance) {
+    vulkan_hal::CountStat(vulkan_hal::kStatProcHook);
+    return hook->proc;
+  }
 
-  if (strcmp(name, "vkGetDeviceProcAddr") == 0)
-    return reinterpret_cast<PFN_vkVoidFunction>(GetDeviceProcAddr);
+  if (!mesa_vulkan::InitializeVulkan())
+    return nullptr;
 
+  PFN_vkVoidFunction pfn;
   if ((pfn = reinterpret_cast<PFN_vkVoidFunction>(
            mesa_vulkan::vkGetInstanceProcAddr(instance, name)))) {
+    if (hook && hook->type == ProcHookType::kInstanceWrapper) {
+      vulkan_hal::CountStat(vulkan_hal::kStatProcHook);
+      return hook->proc;
+    }
     return pfn;
   }
 
@@ -176,7 +879,39 @@ static PFN_vkVoidFunction GetInstanceProcAddr(VkInstance instance,
 static VkResult CreateInstance(const VkInstanceCreateInfo* create_info,
                                const VkAllocationCallbacks* allocator,
                                VkInstance* instance) {
-  return mesa_vulkan::vkCreateInstance(create_info, allocator, instance);
+  if (!mesa_vulkan::InitializeVulkan())
+    return VK_ERROR_INCOMPATIBLE_DRIVER;
+
+  // keep the driver loaded for as long as the instance lives, even if the
+  // hw device gets closed in the meantime
+  mesa_vulkan::Open();
+  VkResult result =
+      mesa_vulkan::vkCreateInstance(create_info, allocator, instance);
+  if (result != VK_SUCCESS) {
+    mesa_vulkan::Close();
+    return result;
+  }
+
+  if (!vulkan_hal::RegisterInstance(*instance)) {
+    DestroyInstance(*instance, allocator);
+    *instance = VK_NULL_HANDLE;
+    return VK_ERROR_INITIALIZATION_FAILED;
+  }
+
+  return VK_SUCCESS;
+}
+
+static void DestroyInstance(VkInstance instance,
+                            const VkAllocationCallbacks* allocator) {
+  if (instance == VK_NULL_HANDLE)
+    return;
+
+  vulkan_hal::UnregisterInstance(instance);
+  PFN_vkDestroyInstance destroyInstance =
+      reinterpret_cast<PFN_vkDestroyInstance>(
+          mesa_vulkan::vkGetInstanceProcAddr(instance, "vkDestroyInstance"));
+  destroyInstance(instance, allocator);
+  mesa_vulkan::Close();
 }
 
 // Declare HAL_MODULE_INFO_SYM here so it can be referenced by
@@ -215,12 +950,9 @@ hwvulkan_device_t mesa_vulkan_device = {
 
 int OpenDevice(const hw_module_t* /*module*/, const char* id,
                hw_device_t** device) {
+  // the driver itself is loaded on first use, see InitializeVulkan
   if (strcmp(id, HWVULKAN_DEVICE_0) == 0) {
-    if (!mesa_vulkan::InitializeVulkan()) {
-      ALOGE("%s: Failed to initialize Vulkan.", __func__);
-      return -ENOENT;
-    }
-
+    mesa_vulkan::Open();
     *device = &mesa_vulkan_device.common;
     return 0;
   }
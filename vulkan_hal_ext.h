@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_HAL_EXT_H
+#define VULKAN_HAL_EXT_H
+
+#define VK_NO_PROTOTYPES 1
+#include <vulkan/vulkan.h>
+#include <vulkan/vk_android_native_buffer.h>
+
+// Entry points this HAL exposes through vkGetDeviceProcAddr on top of the
+// ones of VK_ANDROID_native_buffer. They are not part of any Khronos
+// extension and carry a vkHal prefix so that no future one can clash with
+// them, callers have to check for a NULL proc address. The platform's
+// swapchain does not look them up yet; until it does, vulkan_hal_benchmark
+// is their only caller.
+
+// Imports the gralloc buffers of a swapchain ahead of its vkCreateImage
+// calls, with the format and extent of pCreateInfo. The images are kept in
+// the import cache unreferenced until vkCreateImage claims them, and count
+// against the cache's bound on pre-imports until then. The dma-bufs of the
+// buffers are identified in one pass rather than once per cache lookup and
+// insertion of each. With async set the imports run on a HAL worker thread
+// and the call returns before they are done; the buffer handles are cloned
+// and need not outlive the call either way.
+typedef VkResult(VKAPI_PTR* PFN_vkHalPrepareNativeBuffers)(
+    VkDevice device,
+    const VkImageCreateInfo* pCreateInfo,
+    uint32_t bufferCount,
+    const VkNativeBufferANDROID* pBuffers,
+    VkBool32 async);
+
+// Timestamps of the latest present of a swapchain image, in ns of
+// CLOCK_MONOTONIC like the times of VK_GOOGLE_display_timing, 0 where not
+// known. gpuCompleteTime - releaseQueueTime bounds how long the GPU took
+// for the frame. It stays 0 for a present without GPU work of its own,
+// released without wait semaphores or straight from the acquire ones.
+// acquireFenceTime is from the latest acquire of the image, when the
+// compositor let go of the buffer.
+typedef struct VkHalNativeBufferTiming {
+  uint64_t acquireFenceTime;
+  uint64_t releaseQueueTime;
+  uint64_t gpuCompleteTime;
+} VkHalNativeBufferTiming;
+
+// Reads the timing of the latest present of image, for the platform's
+// display timing feedback. Timings are kept from device creation on.
+// Returns VK_NOT_READY for an image that was not presented yet, and for
+// one whose present the GPU has not finished, with the times known so far
+// filled in.
+typedef VkResult(VKAPI_PTR* PFN_vkHalGetNativeBufferTiming)(
+    VkDevice device,
+    VkImage image,
+    VkHalNativeBufferTiming* pTiming);
+
+// Hands the HAL the acquire fence of a swapchain image the platform
+// dequeued ahead of the app's vkAcquireNextImageKHR. The HAL owns
+// nativeFenceFd from here on, -1 stands for a buffer that is ready. With
+// several images queued the app can take whichever one the compositor
+// releases first with vkHalAcquireQueuedImage.
+typedef VkResult(VKAPI_PTR* PFN_vkHalQueueNativeBufferFence)(
+    VkDevice device,
+    VkImage image,
+    int nativeFenceFd);
+
+// Acquires one of the images of a swapchain that have a queued fence: the
+// first one whose fence signals within timeout ns. Its fence is then handed
+// to semaphore and fence the way vkAcquireImageANDROID does and pImageIndex
+// is set to its index in pImages. The call blocks for timeout at most:
+// when no fence signals in time it returns VK_TIMEOUT, or VK_NOT_READY for
+// a timeout of 0, and the fences stay queued for a later acquire. Returns
+// VK_NOT_READY as well when none of pImages has a queued fence.
+typedef VkResult(VKAPI_PTR* PFN_vkHalAcquireQueuedImage)(
+    VkDevice device,
+    uint32_t imageCount,
+    const VkImage* pImages,
+    uint64_t timeout,
+    VkSemaphore semaphore,
+    VkFence fence,
+    uint32_t* pImageIndex);
+
+#endif
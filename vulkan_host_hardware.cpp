@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// hw_get_module for host builds of the HAL and its benchmark.
+//
+// libhardware is only built for the device, so host modules link this
+// instead. It loads a module the way libhardware does, minus the variant
+// properties and the search path: module id comes from <id>.host.so, found
+// through the library path, and has to export HAL_MODULE_INFO_SYM.
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <cutils/log.h>
+#include <hardware/hardware.h>
+
+extern "C" {
+
+int hw_get_module(const char* id, const struct hw_module_t** module) {
+  char name[64];
+  int length = snprintf(name, sizeof(name), "%s.host.so", id);
+  if (length < 0 || static_cast<size_t>(length) >= sizeof(name))
+    return -EINVAL;
+
+  void* handle = dlopen(name, RTLD_NOW);
+  if (!handle) {
+    ALOGE("%s: failed to load %s. %s", __func__, name, dlerror());
+    return -ENOENT;
+  }
+
+  struct hw_module_t* hmi = static_cast<struct hw_module_t*>(
+      dlsym(handle, HAL_MODULE_INFO_SYM_AS_STR));
+  if (!hmi || hmi->tag != HARDWARE_MODULE_TAG || strcmp(hmi->id, id) != 0) {
+    ALOGE("%s: %s is not a %s module", __func__, name, id);
+    dlclose(handle);
+    return -EINVAL;
+  }
+
+  hmi->dso = handle;
+  *module = hmi;
+  return 0;
+}
+
+}  // extern "C"
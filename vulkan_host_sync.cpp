@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// libsync for host builds of the HAL.
+//
+// libsync is only built for the device, so the host module links this
+// instead. It implements the legacy API the HAL uses on top of the
+// sync_file ioctls of the desktop kernel, the same way libsync does on
+// kernels without the old sw_sync interface.
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <linux/sync_file.h>
+#include <sync/sync.h>
+
+extern "C" {
+
+int sync_wait(int fd, int timeout) {
+  struct pollfd pfd = {fd, POLLIN, 0};
+  int ret;
+  do {
+    ret = poll(&pfd, 1, timeout);
+  } while (ret == -1 && (errno == EINTR || errno == EAGAIN));
+  if (ret == 0) {
+    errno = ETIME;
+    return -1;
+  }
+  if (ret < 0)
+    return ret;
+  if (pfd.revents & (POLLERR | POLLNVAL)) {
+    errno = EINVAL;
+    return -1;
+  }
+  return 0;
+}
+
+int sync_merge(const char* name, int fd1, int fd2) {
+  struct sync_merge_data data;
+  memset(&data, 0, sizeof(data));
+  strncpy(data.name, name, sizeof(data.name) - 1);
+  data.fd2 = fd2;
+  if (ioctl(fd1, SYNC_IOC_MERGE, &data) < 0)
+    return -1;
+  return data.fence;
+}
+
+struct sync_fence_info_data* sync_fence_info(int fd) {
+  struct sync_file_info file;
+  memset(&file, 0, sizeof(file));
+  // the first call only reports the number of fences in the sync_file
+  if (ioctl(fd, SYNC_IOC_FILE_INFO, &file) < 0)
+    return NULL;
+
+  uint32_t count = file.num_fences;
+  struct sync_fence_info* fences = static_cast<struct sync_fence_info*>(
+      calloc(count ? count : 1, sizeof(*fences)));
+  if (!fences)
+    return NULL;
+  file.sync_fence_info = reinterpret_cast<uintptr_t>(fences);
+  if (count && ioctl(fd, SYNC_IOC_FILE_INFO, &file) < 0) {
+    free(fences);
+    return NULL;
+  }
+
+  size_t size = sizeof(struct sync_fence_info_data) +
+                count * sizeof(struct sync_pt_info);
+  struct sync_fence_info_data* info =
+      static_cast<struct sync_fence_info_data*>(calloc(1, size));
+  if (!info) {
+    free(fences);
+    return NULL;
+  }
+  info->len = static_cast<uint32_t>(size);
+  memcpy(info->name, file.name, sizeof(info->name));
+  info->status = file.status;
+
+  struct sync_pt_info* pts = reinterpret_cast<struct sync_pt_info*>(
+      info->pt_info);
+  for (uint32_t i = 0; i < count; i++) {
+    pts[i].len = sizeof(pts[i]);
+    memcpy(pts[i].obj_name, fences[i].obj_name, sizeof(pts[i].obj_name));
+    memcpy(pts[i].driver_name, fences[i].driver_name,
+           sizeof(pts[i].driver_name));
+    pts[i].status = fences[i].status;
+    pts[i].timestamp_ns = fences[i].timestamp_ns;
+  }
+  free(fences);
+  return info;
+}
+
+struct sync_pt_info* sync_pt_info(struct sync_fence_info_data* info,
+                                  struct sync_pt_info* itr) {
+  uint8_t* next = itr ? reinterpret_cast<uint8_t*>(itr) + itr->len
+                      : info->pt_info;
+  if (next >= reinterpret_cast<uint8_t*>(info) + info->len)
+    return NULL;
+  return reinterpret_cast<struct sync_pt_info*>(next);
+}
+
+void sync_fence_info_free(struct sync_fence_info_data* info) {
+  free(info);
+}
+
+}  // extern "C"
@@ -0,0 +1,504 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+#include <mutex>
+#include <cutils/log.h>
+#include <drm/drm.h>
+
+#include "vulkan_arena.h"
+#include "vulkan_device.h"
+#include "vulkan_driver.h"
+#include "vulkan_image_cache.h"
+#include "vulkan_stats.h"
+
+namespace vulkan_hal {
+
+namespace {
+
+struct CacheEntry {
+  // key.fd and key.batch belong to the caller and are not used once
+  // inserted
+  ImageImportKey key;
+  // the dma-buf's inode or GEM handle, see ImageImportKey, entries that
+  // could not be identified are never found
+  bool identified;
+  uint64_t bufferId;
+  VkImage image;
+  VkDeviceMemory memory;
+  // size of memory, counted against kMaxIdleBytes while idle
+  VkDeviceSize size;
+  uint32_t refCount;
+  // a pre-import nobody has used yet, bounded by kMaxPreparedImages rather
+  // than counted as idle
+  bool prepared;
+  // when the entry last went idle or was pre-imported, orders eviction
+  uint64_t idleSerial;
+  // the import allocated image and memory with these, keep a copy as the
+  // app's pointer does not need to stay valid
+  bool hasAllocator;
+  VkAllocationCallbacks allocator;
+  CacheEntry* next;
+};
+
+bool KeysEqual(const ImageImportKey& a, const ImageImportKey& b) {
+  return a.format == b.format && a.extent.width == b.extent.width &&
+         a.extent.height == b.extent.height &&
+         a.extent.depth == b.extent.depth && a.usage == b.usage &&
+         a.modifier == b.modifier && a.strideInBytes == b.strideInBytes &&
+         a.protectedContent == b.protectedContent;
+}
+
+void DestroyEntry(DeviceContext* ctx, CacheEntry* entry) {
+  const VkAllocationCallbacks* allocator =
+      entry->hasAllocator ? &entry->allocator : NULL;
+  ctx->destroyImage(ctx->device, entry->image, allocator);
+  ctx->freeMemory(ctx->device, entry->memory, allocator);
+  ArenaDelete(ctx->arena, entry);
+}
+
+// Destroys the entries EvictIdle unlinked, chained through next.
+void DestroyEntries(DeviceContext* ctx, CacheEntry* entry) {
+  while (entry) {
+    CacheEntry* next = entry->next;
+    DestroyEntry(ctx, entry);
+    entry = next;
+  }
+}
+
+// Since Linux 5.3 every dma-buf has an inode of its own, before that they
+// all share the anonymous inode.
+bool HasDmaBufInodes() {
+  struct utsname name;
+  unsigned int major;
+  unsigned int minor;
+  if (uname(&name) != 0 ||
+      sscanf(name.release, "%u.%u", &major, &minor) != 2)
+    return false;
+  return major > 5 || (major == 5 && minor >= 3);
+}
+
+struct BatchBuffer {
+  int fd;
+  bool identified;
+  uint64_t bufferId;
+};
+
+}  // namespace
+
+struct ImportBatch {
+  explicit ImportBatch(Arena* arena) : buffers(arena), next(nullptr) {}
+
+  ArenaVector<BatchBuffer> buffers;
+  // in the cache's list of open batches, whose GEM handles Forget keeps
+  ImportBatch* next;
+};
+
+struct ImageCache {
+  std::mutex lock;
+  CacheEntry* entries;
+  uint32_t liveCount;
+  uint32_t idleCount;
+  uint32_t peakIdleCount;
+  VkDeviceSize idleBytes;
+  uint32_t preparedCount;
+  uint64_t idleClock;
+  // dma-bufs are told apart by inode, otherwise by GEM handles on drmFd
+  bool inodeIdentity;
+  int drmFd;
+  ImportBatch* batches;
+
+  // the helpers below must be called with lock held
+
+  // Works out which dma-buf fd refers to. PRIME import hands out one GEM
+  // handle per buffer object and drmFd, not refcounting them, so a handle
+  // stays unique to its dma-buf only until Forget closes it. The lock keeps
+  // handles from being closed under any other lookup.
+  bool IdentifyFd(int fd, uint64_t* bufferId) {
+    if (inodeIdentity) {
+      struct stat st;
+      if (fstat(fd, &st) != 0) {
+        ALOGE("%s: failed to stat dma-buf fd %d", __func__, fd);
+        return false;
+      }
+      *bufferId = st.st_ino;
+      return true;
+    }
+
+    if (drmFd < 0)
+      return false;
+    struct drm_prime_handle prime = {};
+    prime.fd = fd;
+    if (ioctl(drmFd, DRM_IOCTL_PRIME_FD_TO_HANDLE, &prime) != 0) {
+      ALOGE("%s: failed to import dma-buf fd %d: %d", __func__, fd, errno);
+      return false;
+    }
+    *bufferId = prime.handle;
+    return true;
+  }
+
+  // Identifies the dma-buf of key, taking what its batch already worked
+  // out for the fd.
+  bool Identify(const ImageImportKey& key, uint64_t* bufferId) {
+    if (key.batch) {
+      for (BatchBuffer& buffer : key.batch->buffers) {
+        if (buffer.fd == key.fd) {
+          *bufferId = buffer.bufferId;
+          return buffer.identified;
+        }
+      }
+    }
+    return IdentifyFd(key.fd, bufferId);
+  }
+
+  // Closes the GEM handle of bufferId once neither an inserted entry nor an
+  // open batch uses it.
+  void Forget(uint64_t bufferId) {
+    if (inodeIdentity)
+      return;
+    for (CacheEntry* entry = entries; entry; entry = entry->next) {
+      if (entry->identified && entry->bufferId == bufferId)
+        return;
+    }
+    for (ImportBatch* batch = batches; batch; batch = batch->next) {
+      for (BatchBuffer& buffer : batch->buffers) {
+        if (buffer.identified && buffer.bufferId == bufferId)
+          return;
+      }
+    }
+    struct drm_gem_close request = {};
+    request.handle = static_cast<uint32_t>(bufferId);
+    if (ioctl(drmFd, DRM_IOCTL_GEM_CLOSE, &request) != 0)
+      ALOGE("%s: failed to close GEM handle %u: %d", __func__,
+            request.handle, errno);
+  }
+
+  CacheEntry* Find(uint64_t bufferId, const ImageImportKey& key) {
+    CacheEntry* entry = entries;
+    while (entry && !(entry->identified && entry->bufferId == bufferId &&
+                      KeysEqual(entry->key, key)))
+      entry = entry->next;
+    return entry;
+  }
+
+  void Unlink(CacheEntry** link) {
+    CacheEntry* entry = *link;
+    *link = entry->next;
+    liveCount--;
+    if (entry->identified)
+      Forget(entry->bufferId);
+  }
+
+  void MarkPrepared(CacheEntry* entry) {
+    entry->prepared = true;
+    entry->idleSerial = ++idleClock;
+    preparedCount++;
+  }
+
+  void MarkIdle(CacheEntry* entry) {
+    entry->idleSerial = ++idleClock;
+    idleBytes += entry->size;
+    if (++idleCount > peakIdleCount)
+      peakIdleCount = idleCount;
+  }
+
+  // Takes a reference on entry, reviving it if it was idle or taking a
+  // pre-import into use.
+  void Reference(CacheEntry* entry) {
+    if (entry->refCount++ == 0) {
+      if (entry->prepared) {
+        entry->prepared = false;
+        preparedCount--;
+      } else {
+        idleCount--;
+        idleBytes -= entry->size;
+      }
+      CountStat(kStatImportPoolReuse);
+    }
+  }
+
+  bool OverBounds(const CacheEntry* entry) const {
+    if (entry->prepared)
+      return preparedCount > kMaxPreparedImages;
+    return idleCount > kMaxIdleImages || idleBytes > kMaxIdleBytes;
+  }
+
+  // Unlinks the least recently idled entries until the idle ones are back
+  // within kMaxIdleImages and kMaxIdleBytes and the pre-imports within
+  // kMaxPreparedImages. An idle entry that was never identified can not be
+  // reused and always goes. Returns the unlinked entries chained through
+  // next, for the caller to destroy once the lock is dropped.
+  CacheEntry* EvictIdle() {
+    CacheEntry* evicted = nullptr;
+    for (;;) {
+      CacheEntry** oldest = nullptr;
+      for (CacheEntry** link = &entries; *link; link = &(*link)->next) {
+        if ((*link)->refCount)
+          continue;
+        if (!(*link)->identified) {
+          oldest = link;
+          break;
+        }
+        if (OverBounds(*link) &&
+            (!oldest || (*link)->idleSerial < (*oldest)->idleSerial))
+          oldest = link;
+      }
+      if (!oldest)
+        return evicted;
+
+      CacheEntry* entry = *oldest;
+      Unlink(oldest);
+      if (entry->prepared) {
+        preparedCount--;
+      } else {
+        idleCount--;
+        idleBytes -= entry->size;
+      }
+      CountStat(kStatImportPoolEvict);
+      entry->next = evicted;
+      evicted = entry;
+    }
+  }
+};
+
+ImageCache* CreateImageCache(Arena* arena) {
+  ImageCache* cache = ArenaNew<ImageCache>(arena);
+  if (!cache)
+    return nullptr;
+  cache->entries = nullptr;
+  cache->liveCount = 0;
+  cache->idleCount = 0;
+  cache->peakIdleCount = 0;
+  cache->idleBytes = 0;
+  cache->preparedCount = 0;
+  cache->idleClock = 0;
+  cache->inodeIdentity = HasDmaBufInodes();
+  cache->drmFd = cache->inodeIdentity ? -1 : OpenRenderNode();
+  cache->batches = nullptr;
+  ALOGW_IF(!cache->inodeIdentity && cache->drmFd < 0,
+           "%s: can not tell dma-bufs apart, imports are not reused",
+           __func__);
+  return cache;
+}
+
+void DestroyImageCache(DeviceContext* ctx) {
+  if (!ctx->imageCache)
+    return;
+  CacheEntry* entry = ctx->imageCache->entries;
+  while (entry) {
+    CacheEntry* next = entry->next;
+    ALOGW_IF(entry->refCount, "%s: image still referenced at device destroy",
+             __func__);
+    DestroyEntry(ctx, entry);
+    entry = next;
+  }
+  // closing the fd closes every GEM handle still open on it
+  if (ctx->imageCache->drmFd >= 0)
+    close(ctx->imageCache->drmFd);
+  ArenaDelete(ctx->arena, ctx->imageCache);
+  ctx->imageCache = nullptr;
+}
+
+VkImage AcquireCachedImage(DeviceContext* ctx,
+                           const ImageImportKey& key,
+                           bool addReference) {
+  ImageCache* cache = ctx->imageCache;
+  std::lock_guard<std::mutex> lock(cache->lock);
+
+  uint64_t bufferId;
+  if (!cache->Identify(key, &bufferId))
+    return VK_NULL_HANDLE;
+  CacheEntry* entry = cache->Find(bufferId, key);
+  if (!entry) {
+    // the import to come identifies the buffer again when inserting it, or
+    // finds it in the batch that keeps the handle open until then
+    cache->Forget(bufferId);
+    return VK_NULL_HANDLE;
+  }
+
+  if (addReference)
+    cache->Reference(entry);
+  return entry->image;
+}
+
+VkResult InsertCachedImage(DeviceContext* ctx,
+                           const ImageImportKey& key,
+                           VkImage image,
+                           VkDeviceMemory memory,
+                           const VkAllocationCallbacks* pAllocator,
+                           bool addReference,
+                           VkImage* pImage) {
+  CacheEntry* entry = ArenaNew<CacheEntry>(ctx->arena);
+  if (!entry) {
+    ALOGE("%s: out of host memory", __func__);
+    ctx->destroyImage(ctx->device, image, pAllocator);
+    ctx->freeMemory(ctx->device, memory, pAllocator);
+    *pImage = VK_NULL_HANDLE;
+    return VK_ERROR_OUT_OF_HOST_MEMORY;
+  }
+  entry->key = key;
+  entry->image = image;
+  entry->memory = memory;
+  VkMemoryRequirements requirements = {};
+  if (ctx->getImageMemoryRequirements)
+    ctx->getImageMemoryRequirements(ctx->device, image, &requirements);
+  entry->size = requirements.size;
+  entry->refCount = addReference ? 1 : 0;
+  entry->prepared = false;
+  entry->hasAllocator = pAllocator != NULL;
+  if (pAllocator)
+    entry->allocator = *pAllocator;
+
+  ImageCache* cache = ctx->imageCache;
+  CacheEntry* existing;
+  CacheEntry* evicted = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(cache->lock);
+    entry->identified = cache->Identify(key, &entry->bufferId);
+    existing =
+        entry->identified ? cache->Find(entry->bufferId, key) : nullptr;
+    if (existing) {
+      if (addReference)
+        cache->Reference(existing);
+      image = existing->image;
+    } else {
+      entry->next = cache->entries;
+      cache->entries = entry;
+      cache->liveCount++;
+      if (!addReference) {
+        cache->MarkPrepared(entry);
+        evicted = cache->EvictIdle();
+        for (CacheEntry* victim = evicted; victim; victim = victim->next) {
+          if (victim == entry)
+            image = VK_NULL_HANDLE;
+        }
+      }
+    }
+  }
+
+  if (existing)
+    DestroyEntry(ctx, entry);
+  DestroyEntries(ctx, evicted);
+
+  *pImage = image;
+  return VK_SUCCESS;
+}
+
+bool ReleaseCachedImage(DeviceContext* ctx, VkImage image) {
+  ImageCache* cache = ctx->imageCache;
+  CacheEntry* evicted = nullptr;
+  bool found;
+  {
+    std::lock_guard<std::mutex> lock(cache->lock);
+    CacheEntry* entry = cache->entries;
+    while (entry && entry->image != image)
+      entry = entry->next;
+
+    found = entry != nullptr;
+    if (found && --entry->refCount == 0) {
+      cache->MarkIdle(entry);
+      evicted = cache->EvictIdle();
+    }
+  }
+
+  DestroyEntries(ctx, evicted);
+
+  return found;
+}
+
+ImportBatch* BeginImportBatch(DeviceContext* ctx,
+                              const int* fds,
+                              uint32_t fdCount) {
+  ImportBatch* batch = ArenaNew<ImportBatch>(ctx->arena, ctx->arena);
+  if (!batch || !batch->buffers.reserve(fdCount)) {
+    ALOGE("%s: out of host memory", __func__);
+    ArenaDelete(ctx->arena, batch);
+    return nullptr;
+  }
+
+  ImageCache* cache = ctx->imageCache;
+  std::lock_guard<std::mutex> lock(cache->lock);
+  for (uint32_t i = 0; i < fdCount; i++) {
+    if (fds[i] < 0)
+      continue;
+    BatchBuffer buffer;
+    buffer.fd = fds[i];
+    buffer.identified = cache->IdentifyFd(fds[i], &buffer.bufferId);
+    // can not fail, the space is reserved
+    batch->buffers.push_back(std::move(buffer));
+  }
+  batch->next = cache->batches;
+  cache->batches = batch;
+  return batch;
+}
+
+void EndImportBatch(DeviceContext* ctx, ImportBatch* batch) {
+  if (!batch)
+    return;
+
+  ImageCache* cache = ctx->imageCache;
+  {
+    std::lock_guard<std::mutex> lock(cache->lock);
+    ImportBatch** link = &cache->batches;
+    while (*link != batch)
+      link = &(*link)->next;
+    *link = batch->next;
+
+    // two fds of one dma-buf share a handle, close it only once
+    for (BatchBuffer* buffer = batch->buffers.begin();
+         buffer != batch->buffers.end(); buffer++) {
+      if (!buffer->identified)
+        continue;
+      bool seen = false;
+      for (BatchBuffer* earlier = batch->buffers.begin(); earlier != buffer;
+           earlier++)
+        seen = seen || (earlier->identified &&
+                        earlier->bufferId == buffer->bufferId);
+      if (!seen)
+        cache->Forget(buffer->bufferId);
+    }
+  }
+  ArenaDelete(ctx->arena, batch);
+}
+
+void GetImageCacheStats(DeviceContext* ctx, ImageCacheStats* stats) {
+  ImageCache* cache = ctx->imageCache;
+  std::lock_guard<std::mutex> lock(cache->lock);
+  stats->liveCount = cache->liveCount;
+  stats->idleCount = cache->idleCount;
+  stats->peakIdleCount = cache->peakIdleCount;
+  stats->idleBytes = cache->idleBytes;
+  stats->preparedCount = cache->preparedCount;
+}
+
+void DumpImageCacheStats(DeviceContext* ctx) {
+  if (!StatsDumpEnabled())
+    return;
+
+  ImageCacheStats stats;
+  GetImageCacheStats(ctx, &stats);
+  ALOGI("import pool: %u imports, %u idle in %llu KB, peak %u idle of %u, "
+        "%u pre-imported",
+        stats.liveCount, stats.idleCount,
+        static_cast<unsigned long long>(stats.idleBytes / 1024),
+        stats.peakIdleCount, kMaxIdleImages, stats.preparedCount);
+}
+}
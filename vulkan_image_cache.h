@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_IMAGE_CACHE_H
+#define VULKAN_IMAGE_CACHE_H
+
+#define VK_NO_PROTOTYPES 1
+#include <vulkan/vulkan.h>
+
+namespace vulkan_hal {
+
+// Identifies one dma-buf import. Which dma-buf fd refers to is worked out
+// by the cache: by the inode behind fd on kernels since 5.3, which give
+// each dma-buf its own, and by the GEM handle a PRIME import on the HAL's
+// own render node fd returns before that, when all dma-bufs share a single
+// anonymous inode.
+struct ImportBatch;
+
+struct ImageImportKey {
+  // the dma-buf, not owned
+  int fd;
+  // the batch fd was identified in, or NULL to identify it on every lookup
+  ImportBatch* batch;
+  VkFormat format;
+  VkExtent3D extent;
+  VkImageUsageFlags usage;
+  uint64_t modifier;
+  uint32_t strideInBytes;
+  bool protectedContent;
+};
+
+struct Arena;
+struct DeviceContext;
+struct ImageCache;
+
+ImageCache* CreateImageCache(Arena* arena);
+
+// Destroys every import still held on the device and the cache itself,
+// called before the device goes away.
+void DestroyImageCache(DeviceContext* ctx);
+
+// Returns the image already imported for key on the device, or
+// VK_NULL_HANDLE if there is none. Takes a reference on it if addReference
+// is set.
+VkImage AcquireCachedImage(DeviceContext* ctx,
+                           const ImageImportKey& key,
+                           bool addReference);
+
+// Adds a freshly imported image/memory pair, with a single reference if
+// addReference is set and none for a pre-import nobody uses yet, which only
+// counts as idle once it has been used and released, and
+// returns the image to use in *pImage. If another thread raced us to the
+// same import the new pair is destroyed and the cached image returned
+// instead. A dma-buf the cache can not identify is tracked without ever
+// being reused, so a pre-import of one is destroyed right away and
+// VK_NULL_HANDLE returned. Out of host memory the pair is destroyed as well.
+VkResult InsertCachedImage(DeviceContext* ctx,
+                           const ImageImportKey& key,
+                           VkImage image,
+                           VkDeviceMemory memory,
+                           const VkAllocationCallbacks* pAllocator,
+                           bool addReference,
+                           VkImage* pImage);
+
+// Drops a reference on image. The last one leaves the import idle in the
+// cache for the buffer to come back, the least recently used idle imports
+// beyond kMaxIdleImages or kMaxIdleBytes are destroyed with their memory.
+// Returns false if image was not imported through the cache.
+bool ReleaseCachedImage(DeviceContext* ctx, VkImage image);
+
+// Bounds on the unreferenced imports a device keeps. Each one pins its
+// dma-buf, so gralloc freeing the buffer does not give the memory back
+// while it sits here. About one swapchain's worth is kept, enough for a
+// swapchain recreated with the same buffers; a triple buffered 4K RGBA
+// swapchain is close to 100MB.
+const uint32_t kMaxIdleImages = 4;
+const VkDeviceSize kMaxIdleBytes = 128 * 1024 * 1024;
+// Pre-imports are bounded on their own until their first use, so
+// preparing a whole swapchain does not evict it before vkCreateImage gets
+// to it: room for the new swapchain and the old one it replaces.
+const uint32_t kMaxPreparedImages = 8;
+
+// Works out which dma-bufs the fds of a batch of imports refer to, in one
+// pass under the cache lock, for the keys naming the batch to be looked up
+// and inserted with. Before Linux 5.3 that is one PRIME import per buffer
+// kept open until EndImportBatch, where an import on its own PRIME imports
+// its buffer for the lookup, closes the handle on a miss and imports it
+// again for the insertion. The fds must stay open until the imports naming
+// the batch are done, negative ones are skipped. Returns NULL out of host
+// memory, the imports then identify their buffers one by one.
+ImportBatch* BeginImportBatch(DeviceContext* ctx,
+                              const int* fds,
+                              uint32_t fdCount);
+
+// Closes the GEM handles of the batch no inserted import uses and frees it.
+// Does nothing for a NULL batch.
+void EndImportBatch(DeviceContext* ctx, ImportBatch* batch);
+
+struct ImageCacheStats {
+  uint32_t liveCount;
+  uint32_t idleCount;
+  uint32_t peakIdleCount;
+  VkDeviceSize idleBytes;
+  uint32_t preparedCount;
+};
+
+void GetImageCacheStats(DeviceContext* ctx, ImageCacheStats* stats);
+
+// Logs the pool occupancy of the device when StatsDumpEnabled().
+void DumpImageCacheStats(DeviceContext* ctx);
+}
+
+#endif
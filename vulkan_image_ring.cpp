@@ -0,0 +1,280 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <atomic>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <cutils/log.h>
+
+#include "vulkan_arena.h"
+#include "vulkan_device.h"
+#include "vulkan_image_ring.h"
+#include "vulkan_stats.h"
+
+namespace vulkan_hal {
+
+namespace {
+
+struct RingEntry {
+  VkImage image;
+  RingState state;
+  // tells the fence an acquire took for polling from one queued meanwhile
+  uint64_t queueSerial;
+  FenceFd fence;
+  // set while an acquire polls the fence outside the lock, a fence queued
+  // meanwhile replaces it
+  bool polling;
+};
+
+typedef ArenaVector<RingEntry> RingEntries;
+
+RingEntry* FindEntry(RingEntries* entries, VkImage image) {
+  for (RingEntry& entry : *entries) {
+    if (entry.image == image)
+      return &entry;
+  }
+  return nullptr;
+}
+
+// A swapchain rarely has more than four images.
+const uint32_t kInlineCandidateCount = 8;
+
+struct Candidate {
+  uint32_t index;
+  uint64_t queueSerial;
+  FenceFd fence;
+};
+
+// Deadline of a wait of timeout ns from now, UINT64_MAX for none.
+uint64_t GetDeadline(uint64_t timeout) {
+  if (timeout == UINT64_MAX)
+    return UINT64_MAX;
+  const uint64_t now = NowNs();
+  return timeout > UINT64_MAX - now ? UINT64_MAX : now + timeout;
+}
+
+// The poll timeout left until deadline, rounded up so a short timeout
+// still waits at all.
+int GetPollTimeout(uint64_t deadline) {
+  if (deadline == UINT64_MAX)
+    return -1;
+  const uint64_t now = NowNs();
+  if (now >= deadline)
+    return 0;
+  const uint64_t ms = (deadline - now + 999999) / 1000000;
+  return ms > INT_MAX ? INT_MAX : static_cast<int>(ms);
+}
+
+// Waits for the first of fences to signal, up to deadline. Returns its
+// index, or count if none did.
+uint32_t PollFirstSignaled(const Candidate* candidates,
+                           uint32_t count,
+                           uint64_t deadline,
+                           pollfd* fds) {
+  for (uint32_t i = 0; i < count; i++) {
+    // -1 marks a fence that has already signaled
+    if (candidates[i].fence.Get() < 0)
+      return i;
+    fds[i].fd = candidates[i].fence.Get();
+    fds[i].events = POLLIN;
+    fds[i].revents = 0;
+  }
+
+  // a retry only waits for what is left of the timeout
+  int ready;
+  do {
+    ready = poll(fds, count, GetPollTimeout(deadline));
+  } while (ready < 0 && (errno == EINTR || errno == EAGAIN));
+  if (ready <= 0) {
+    ALOGE_IF(ready < 0, "%s: poll failed: %d", __func__, errno);
+    return count;
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    if (fds[i].revents & (POLLIN | POLLERR))
+      return i;
+  }
+  return count;
+}
+
+}  // namespace
+
+struct ImageRing {
+  explicit ImageRing(Arena* arena)
+      : entries(arena) {}
+
+  std::mutex lock;
+  RingEntries entries;
+  uint64_t queueClock;
+  // set on the first queued fence, read without the lock
+  std::atomic<bool> active;
+};
+
+ImageRing* CreateImageRing(Arena* arena) {
+  ImageRing* ring = ArenaNew<ImageRing>(arena, arena);
+  if (!ring)
+    return nullptr;
+  ring->queueClock = 0;
+  ring->active.store(false, std::memory_order_relaxed);
+  return ring;
+}
+
+void DestroyImageRing(DeviceContext* ctx) {
+  ArenaDelete(ctx->arena, ctx->imageRing);
+  ctx->imageRing = nullptr;
+}
+
+bool ImageRingActive(DeviceContext* ctx) {
+  return ctx->imageRing->active.load(std::memory_order_relaxed);
+}
+
+VkResult QueueRingFence(DeviceContext* ctx, VkImage image, FenceFd fence) {
+  ImageRing* ring = ctx->imageRing;
+  // closed once the lock is dropped
+  FenceFd stale;
+  std::lock_guard<std::mutex> lock(ring->lock);
+
+  RingEntry* entry = FindEntry(&ring->entries, image);
+  if (!entry) {
+    RingEntry added = {image, kRingReleased, 0, FenceFd(), false};
+    if (!ring->entries.push_back(std::move(added))) {
+      ALOGE("%s: out of host memory", __func__);
+      return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+    entry = &ring->entries.back();
+  }
+  ring->active.store(true, std::memory_order_relaxed);
+  ALOGW_IF(entry->state == kRingAcquired,
+           "%s: image queued while the app still holds it", __func__);
+  entry->state = kRingQueued;
+  entry->queueSerial = ++ring->queueClock;
+  entry->polling = false;
+  stale = std::move(entry->fence);
+  entry->fence = std::move(fence);
+  return VK_SUCCESS;
+}
+
+VkResult TakeRingImage(DeviceContext* ctx,
+                       uint32_t imageCount,
+                       const VkImage* pImages,
+                       uint64_t timeout,
+                       uint32_t* pImageIndex,
+                       FenceFd* fence) {
+  ImageRing* ring = ctx->imageRing;
+
+  Candidate inlineCandidates[kInlineCandidateCount];
+  pollfd inlineFds[kInlineCandidateCount];
+  std::vector<Candidate> heapCandidates;
+  std::vector<pollfd> heapFds;
+  Candidate* candidates = inlineCandidates;
+  pollfd* fds = inlineFds;
+  if (imageCount > kInlineCandidateCount) {
+    heapCandidates.resize(imageCount);
+    heapFds.resize(imageCount);
+    candidates = heapCandidates.data();
+    fds = heapFds.data();
+  }
+
+  const uint64_t deadline = GetDeadline(timeout);
+  for (;;) {
+    // the fences are taken out to poll them without the lock
+    uint32_t count = 0;
+    {
+      std::lock_guard<std::mutex> lock(ring->lock);
+      for (uint32_t i = 0; i < imageCount; i++) {
+        RingEntry* entry = FindEntry(&ring->entries, pImages[i]);
+        if (!entry || entry->state != kRingQueued || entry->polling)
+          continue;
+        entry->polling = true;
+        candidates[count].index = i;
+        candidates[count].queueSerial = entry->queueSerial;
+        candidates[count].fence = std::move(entry->fence);
+        count++;
+      }
+    }
+    if (count == 0)
+      return VK_NOT_READY;
+
+    // on a timeout chosen stays count and every fence goes back to the
+    // ring; fences of entries queued again or dropped meanwhile are stale
+    // and closed along with the candidates
+    const uint32_t chosen =
+        PollFirstSignaled(candidates, count, deadline, fds);
+    bool acquired = false;
+    {
+      std::lock_guard<std::mutex> lock(ring->lock);
+      for (uint32_t i = 0; i < count; i++) {
+        RingEntry* entry =
+            FindEntry(&ring->entries, pImages[candidates[i].index]);
+        const bool current = entry && entry->polling &&
+                             entry->queueSerial == candidates[i].queueSerial;
+        if (!current)
+          continue;
+        entry->polling = false;
+        if (i == chosen) {
+          entry->state = kRingAcquired;
+          acquired = true;
+        } else {
+          entry->fence = std::move(candidates[i].fence);
+        }
+      }
+    }
+    if (chosen == count)
+      return timeout == 0 ? VK_NOT_READY : VK_TIMEOUT;
+
+    if (acquired) {
+      *pImageIndex = candidates[chosen].index;
+      *fence = std::move(candidates[chosen].fence);
+      return VK_SUCCESS;
+    }
+    // the image signaled but was queued again or dropped while polling,
+    // look again among what is queued now
+    for (uint32_t i = 0; i < count; i++)
+      candidates[i].fence.Reset();
+  }
+}
+
+void SetRingState(DeviceContext* ctx, VkImage image, RingState state) {
+  ImageRing* ring = ctx->imageRing;
+  FenceFd stale;
+  std::lock_guard<std::mutex> lock(ring->lock);
+  RingEntry* entry = FindEntry(&ring->entries, image);
+  if (!entry)
+    return;
+  entry->state = state;
+  if (state != kRingQueued) {
+    stale = std::move(entry->fence);
+    entry->polling = false;
+  }
+}
+
+void DropRingImage(DeviceContext* ctx, VkImage image) {
+  ImageRing* ring = ctx->imageRing;
+  // closed once the lock is dropped
+  RingEntry dropped = {VK_NULL_HANDLE, kRingReleased, 0, FenceFd(), false};
+  std::lock_guard<std::mutex> lock(ring->lock);
+  RingEntry* entry = FindEntry(&ring->entries, image);
+  if (!entry)
+    return;
+  dropped = std::move(*entry);
+  *entry = std::move(ring->entries.back());
+  ring->entries.pop_back();
+}
+}
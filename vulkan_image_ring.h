@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_IMAGE_RING_H
+#define VULKAN_IMAGE_RING_H
+
+#define VK_NO_PROTOTYPES 1
+#include <vulkan/vulkan.h>
+
+#include "vulkan_fence.h"
+
+namespace vulkan_hal {
+
+struct Arena;
+struct DeviceContext;
+struct ImageRing;
+
+// Where a swapchain image is in its cycle, as far as the ring knows.
+enum RingState {
+  // dequeued by the platform, its acquire fence waits in the ring
+  kRingQueued,
+  // handed to the app, by either acquire path
+  kRingAcquired,
+  // presented, back with the compositor
+  kRingReleased,
+};
+
+ImageRing* CreateImageRing(Arena* arena);
+
+// Closes the queued fences and frees the ring.
+void DestroyImageRing(DeviceContext* ctx);
+
+// Whether any image was ever queued on the device, the ring is left alone
+// otherwise. Takes no lock.
+bool ImageRingActive(DeviceContext* ctx);
+
+// Keeps fence as the acquire fence of image until an acquire takes it,
+// replacing an older one. Out of host memory the fence is closed and
+// VK_ERROR_OUT_OF_HOST_MEMORY returned.
+VkResult QueueRingFence(DeviceContext* ctx, VkImage image, FenceFd fence);
+
+// Picks one of pImages with a queued fence for acquiring: the first whose
+// fence signals within timeout ns. Marks it acquired and returns its index
+// and fence. Returns VK_NOT_READY if none of the images has a queued fence,
+// and if none signals VK_TIMEOUT, or VK_NOT_READY for a timeout of 0, with
+// the fences left queued.
+VkResult TakeRingImage(DeviceContext* ctx,
+                       uint32_t imageCount,
+                       const VkImage* pImages,
+                       uint64_t timeout,
+                       uint32_t* pImageIndex,
+                       FenceFd* fence);
+
+// Notes a state change made outside the ring. Acquiring an image drops the
+// fence queued for it, the acquire brings a newer one.
+void SetRingState(DeviceContext* ctx, VkImage image, RingState state);
+
+// Forgets image, which is being destroyed.
+void DropRingImage(DeviceContext* ctx, VkImage image);
+}
+
+#endif
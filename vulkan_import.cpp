@@ -0,0 +1,489 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <unistd.h>
+#include <cutils/log.h>
+#include <cutils/native_handle.h>
+#include <hardware/gralloc.h>
+
+#include "vulkan_arena.h"
+#include "vulkan_chain.h"
+#include "vulkan_device.h"
+#include "vulkan_format.h"
+#include "vulkan_gralloc.h"
+#include "vulkan_image_cache.h"
+#include "vulkan_import.h"
+#include "vulkan_modifier.h"
+#include "vulkan_stats.h"
+
+namespace vulkan_hal {
+
+namespace {
+
+// imports identified in one pass, as many as the cache keeps pre-imported
+const uint32_t kMaxBatchImports = kMaxPreparedImages;
+
+struct PendingImport {
+  // pNext and the queue family list are dropped
+  VkImageCreateInfo imageInfo;
+  // owned clone of the app's handle, buffer.handle points at it
+  native_handle_t* handle;
+  // the clone is registered with gralloc, which locking it for the plane
+  // layout of a YUV buffer needs
+  bool registered;
+  VkNativeBufferANDROID buffer;
+};
+
+void FreePendingImport(PendingImport* import) {
+  if (import->registered)
+    UnregisterGrallocBuffer(import->handle);
+  native_handle_close(import->handle);
+  native_handle_delete(import->handle);
+}
+
+typedef ArenaVector<PendingImport> PendingImports;
+
+}  // namespace
+
+struct ImportQueue {
+  explicit ImportQueue(Arena* arena)
+      : pending(arena) {}
+
+  std::mutex lock;
+  std::condition_variable cond;
+  PendingImports pending;
+  std::thread worker;
+  bool stop;
+};
+
+namespace {
+
+VkResult ImportDmaBuf(DeviceContext* ctx,
+                      const VkImageCreateInfo& imageInfo,
+                      int fd,
+                      const DmaBufLayout& layout,
+                      const VkAllocationCallbacks* pAllocator,
+                      VkImage* pImage,
+                      VkDeviceMemory* pMemory) {
+  if (!ctx->createDmaBufImage) {
+    ALOGE("%s: driver has no vkCreateDmaBufImageINTEL", __func__);
+    return VK_ERROR_EXTENSION_NOT_PRESENT;
+  }
+
+  VkDmaBufImageCreateInfo dmabufInfo = {
+      .sType = static_cast<VkStructureType>(
+          VK_STRUCTURE_TYPE_DMA_BUF_IMAGE_CREATE_INFO_INTEL),
+      .pNext = NULL,
+      .fd = fd,
+      .format = imageInfo.format,
+      .extent = imageInfo.extent,
+      // Mesa imports the surface as I915_TILING_X and uses this exact value
+      // as row pitch validation for the surface.
+      .strideInBytes = layout.strideInBytes,
+  };
+
+  return ctx->createDmaBufImage(ctx->device, &dmabufInfo, pAllocator,
+                                pMemory, pImage);
+}
+
+// vkCreateDmaBufImageINTEL only knows a single unprotected X tiled plane,
+// multi-planar buffers, other modifiers and protected buffers go through
+// the generic external memory path: an image with the modifier and planes
+// given explicitly, bound to the imported dma-buf. That path is only there
+// on devices created with its extensions enabled. A protected image only
+// reports protected memory types in its requirements.
+VkResult ImportExplicitDmaBuf(DeviceContext* ctx,
+                              const VkImageCreateInfo& imageInfo,
+                              int fd,
+                              uint64_t modifier,
+                              bool protectedContent,
+                              const DmaBufPlanarLayout& layout,
+                              const VkAllocationCallbacks* pAllocator,
+                              VkImage* pImage,
+                              VkDeviceMemory* pMemory) {
+  if (!ctx->explicitDmaBufImport || !ctx->getMemoryFdProperties ||
+      !ctx->createImage || !ctx->getImageMemoryRequirements ||
+      !ctx->allocateMemory || !ctx->bindImageMemory) {
+    ALOGE("%s: device can not import dma-bufs with modifier 0x%llx",
+          __func__, static_cast<unsigned long long>(modifier));
+    return VK_ERROR_FORMAT_NOT_SUPPORTED;
+  }
+
+  VkMemoryFdPropertiesKHR fdProperties = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_FD_PROPERTIES_KHR,
+      .pNext = NULL,
+      .memoryTypeBits = 0,
+  };
+  VkResult result = ctx->getMemoryFdProperties(
+      ctx->device, VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT, fd,
+      &fdProperties);
+  if (result != VK_SUCCESS)
+    return result;
+
+  // The HAL's structures go in front of the caller's chain, which keeps the
+  // format list or anything else it asks for. It can not bring its own
+  // memory or modifier structures, those are the HAL's to fill in. The
+  // Android structures in it are skipped by Mesa.
+  ChainIndex chain;
+  IndexChain(imageInfo.pNext, &chain);
+  if (chain.structs[kChainExternalMemoryImage] ||
+      chain.structs[kChainModifierList] ||
+      chain.structs[kChainModifierExplicit]) {
+    ALOGE("%s: swapchain image with its own external memory info", __func__);
+    return VK_ERROR_FORMAT_NOT_SUPPORTED;
+  }
+
+  const VkImageDrmFormatModifierExplicitCreateInfoEXT modifierInfo = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_DRM_FORMAT_MODIFIER_EXPLICIT_CREATE_INFO_EXT,
+      .pNext = imageInfo.pNext,
+      .drmFormatModifier = modifier,
+      .drmFormatModifierPlaneCount = layout.planeCount,
+      .pPlaneLayouts = layout.planes,
+  };
+  const VkExternalMemoryImageCreateInfo externalInfo = {
+      .sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_IMAGE_CREATE_INFO_KHR,
+      .pNext = &modifierInfo,
+      .handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT,
+  };
+  VkImageCreateInfo createInfo = imageInfo;
+  createInfo.pNext = &externalInfo;
+  createInfo.tiling = VK_IMAGE_TILING_DRM_FORMAT_MODIFIER_EXT;
+  if (protectedContent)
+    createInfo.flags |= VK_IMAGE_CREATE_PROTECTED_BIT;
+
+  VkImage image;
+  result = ctx->createImage(ctx->device, &createInfo, pAllocator, &image);
+  if (result != VK_SUCCESS)
+    return result;
+
+  VkMemoryRequirements requirements;
+  ctx->getImageMemoryRequirements(ctx->device, image, &requirements);
+  // protected images need protected memory, other images must not use it
+  uint32_t memoryTypeBits =
+      requirements.memoryTypeBits & fdProperties.memoryTypeBits &
+      (protectedContent ? ctx->protectedMemoryTypeBits
+                        : ~ctx->protectedMemoryTypeBits);
+  if (!memoryTypeBits) {
+    ALOGE("%s: no %smemory type can hold the dma-buf", __func__,
+          protectedContent ? "protected " : "");
+    ctx->destroyImage(ctx->device, image, pAllocator);
+    return VK_ERROR_INVALID_EXTERNAL_HANDLE;
+  }
+
+  // a successful import takes ownership of the fd, the buffer keeps its own
+  int importFd = dup(fd);
+  if (importFd < 0) {
+    ctx->destroyImage(ctx->device, image, pAllocator);
+    return VK_ERROR_TOO_MANY_OBJECTS;
+  }
+
+  const VkMemoryDedicatedAllocateInfoKHR dedicatedInfo = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO_KHR,
+      .pNext = NULL,
+      .image = image,
+      .buffer = VK_NULL_HANDLE,
+  };
+  const VkImportMemoryFdInfoKHR importInfo = {
+      .sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_FD_INFO_KHR,
+      .pNext = &dedicatedInfo,
+      .handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT,
+      .fd = importFd,
+  };
+  const VkMemoryAllocateInfo allocateInfo = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+      .pNext = &importInfo,
+      .allocationSize = requirements.size,
+      .memoryTypeIndex =
+          static_cast<uint32_t>(__builtin_ctz(memoryTypeBits)),
+  };
+
+  VkDeviceMemory memory;
+  result = ctx->allocateMemory(ctx->device, &allocateInfo, pAllocator,
+                               &memory);
+  if (result != VK_SUCCESS) {
+    close(importFd);
+    ctx->destroyImage(ctx->device, image, pAllocator);
+    return result;
+  }
+
+  result = ctx->bindImageMemory(ctx->device, image, memory, 0);
+  if (result != VK_SUCCESS) {
+    ctx->freeMemory(ctx->device, memory, pAllocator);
+    ctx->destroyImage(ctx->device, image, pAllocator);
+    return result;
+  }
+
+  *pImage = image;
+  *pMemory = memory;
+  return VK_SUCCESS;
+}
+
+// The first dma-buf of buffer, or -1 if the handle has none.
+int GetBufferFd(const VkNativeBufferANDROID* buffer) {
+  const native_handle_t* handle =
+      reinterpret_cast<const native_handle_t*>(buffer->handle);
+  return handle && handle->numFds >= 1 ? handle->data[0] : -1;
+}
+
+// ImportNativeBuffer looking the dma-buf up in batch, if not NULL.
+VkResult ImportBuffer(DeviceContext* ctx,
+                      const VkImageCreateInfo& imageInfo,
+                      const VkNativeBufferANDROID* buffer,
+                      const VkAllocationCallbacks* pAllocator,
+                      bool addReference,
+                      ImportBatch* batch,
+                      VkImage* pImage) {
+  const native_handle_t* handle =
+      reinterpret_cast<const native_handle_t*>(buffer->handle);
+  // every plane is imported from the first dma-buf, gralloc puts them all in
+  // one buffer object
+  if (!handle || handle->numFds < 1) {
+    ALOGE("%s: buffer handle without a dma-buf", __func__);
+    return VK_ERROR_INVALID_EXTERNAL_HANDLE;
+  }
+  const int fd = handle->data[0];
+  const bool planar = IsPlanarFormat(imageInfo.format);
+  // planar buffers are what the camera and video decoder hand out, linear
+  const uint64_t modifier =
+      planar ? kDrmFormatModLinear : GetBufferModifier(buffer);
+  // protected content must never land in memory the GPU can copy out of,
+  // fail rather than import it without protection
+  const bool protectedContent =
+      (buffer->usage & GRALLOC_USAGE_PROTECTED) ||
+      (imageInfo.flags & VK_IMAGE_CREATE_PROTECTED_BIT);
+  if (protectedContent && !ctx->protectedMemory) {
+    ALOGE("%s: protected buffer on a device without a protected queue",
+          __func__);
+    return VK_ERROR_FORMAT_NOT_SUPPORTED;
+  }
+
+  DmaBufLayout layout;
+  DmaBufPlanarLayout planarLayout;
+  VkResult result;
+  if (planar) {
+    result = GetDmaBufPlanarLayout(imageInfo.format, imageInfo.extent, buffer,
+                                   &planarLayout);
+  } else {
+    result = GetDmaBufLayout(imageInfo.format, modifier, buffer, &layout);
+    if (result == VK_SUCCESS) {
+      planarLayout = {};
+      planarLayout.planeCount = 1;
+      planarLayout.planes[0].rowPitch = layout.strideInBytes;
+    }
+  }
+  if (result != VK_SUCCESS)
+    return result;
+
+  // swapchain recreation hands us the same gralloc buffers again, reuse the
+  // earlier import instead of importing the dma-buf once more
+  ImageImportKey key;
+  key.fd = fd;
+  key.batch = batch;
+  key.format = imageInfo.format;
+  key.extent = imageInfo.extent;
+  key.usage = imageInfo.usage;
+  key.modifier = modifier;
+  key.strideInBytes = static_cast<uint32_t>(planarLayout.planes[0].rowPitch);
+  key.protectedContent = protectedContent;
+
+  *pImage = AcquireCachedImage(ctx, key, addReference);
+  if (*pImage != VK_NULL_HANDLE) {
+    CountStat(kStatImportCacheHit);
+    return VK_SUCCESS;
+  }
+
+  VkDeviceMemory mem;
+  VkImage image;
+  if (modifier != kI915FormatModXTiled || protectedContent) {
+    ScopedStat stat(kStatImport, "ImportExplicitDmaBuf");
+    result = ImportExplicitDmaBuf(ctx, imageInfo, fd, modifier,
+                                  protectedContent, planarLayout, pAllocator,
+                                  &image, &mem);
+  } else {
+    ScopedStat stat(kStatImport, "vkCreateDmaBufImageINTEL");
+    result = ImportDmaBuf(ctx, imageInfo, fd, layout, pAllocator, &image,
+                          &mem);
+  }
+  if (result != VK_SUCCESS)
+    return result;
+
+  return InsertCachedImage(ctx, key, image, mem, pAllocator, addReference,
+                           pImage);
+}
+
+// Imports the buffers queued by async PrepareNativeBuffers, each batch of
+// them waiting when the worker wakes up identified in one pass. The fds of
+// a batch stay open until their own import is done, after which no lookup
+// is made in the batch with them.
+void RunImportWorker(DeviceContext* ctx) {
+  ImportQueue* queue = ctx->importQueue;
+  std::unique_lock<std::mutex> lock(queue->lock);
+  for (;;) {
+    queue->cond.wait(
+        lock, [queue] { return queue->stop || !queue->pending.empty(); });
+    if (queue->stop)
+      return;
+
+    uint32_t count = static_cast<uint32_t>(queue->pending.size());
+    int fds[kMaxBatchImports];
+    count = std::min(count, kMaxBatchImports);
+    for (uint32_t i = 0; i < count; i++)
+      fds[i] = GetBufferFd(&queue->pending.begin()[i].buffer);
+    lock.unlock();
+    ImportBatch* batch = BeginImportBatch(ctx, fds, count);
+    lock.lock();
+
+    for (uint32_t i = 0; i < count && !queue->stop; i++) {
+      PendingImport import = *queue->pending.begin();
+      queue->pending.erase(queue->pending.begin());
+      lock.unlock();
+
+      VkImage image;
+      ImportBuffer(ctx, import.imageInfo, &import.buffer, NULL, false, batch,
+                   &image);
+      FreePendingImport(&import);
+
+      lock.lock();
+    }
+
+    lock.unlock();
+    EndImportBatch(ctx, batch);
+    lock.lock();
+  }
+}
+
+}  // namespace
+
+VkResult ImportNativeBuffer(DeviceContext* ctx,
+                            const VkImageCreateInfo& imageInfo,
+                            const VkNativeBufferANDROID* buffer,
+                            const VkAllocationCallbacks* pAllocator,
+                            bool addReference,
+                            VkImage* pImage) {
+  return ImportBuffer(ctx, imageInfo, buffer, pAllocator, addReference,
+                      nullptr, pImage);
+}
+
+VkResult PrepareNativeBuffers(DeviceContext* ctx,
+                              const VkImageCreateInfo* pCreateInfo,
+                              uint32_t bufferCount,
+                              const VkNativeBufferANDROID* pBuffers,
+                              bool async) {
+  // pre-imports are created with the driver's allocator, the app's one is
+  // only known once vkCreateImage claims the image and may well differ
+  if (!async) {
+    VkResult result = VK_SUCCESS;
+    for (uint32_t first = 0; first < bufferCount && result == VK_SUCCESS;
+         first += kMaxBatchImports) {
+      const uint32_t count = std::min(bufferCount - first, kMaxBatchImports);
+      int fds[kMaxBatchImports];
+      for (uint32_t i = 0; i < count; i++)
+        fds[i] = GetBufferFd(&pBuffers[first + i]);
+      ImportBatch* batch = BeginImportBatch(ctx, fds, count);
+      for (uint32_t i = 0; i < count && result == VK_SUCCESS; i++) {
+        VkImage image;
+        result = ImportBuffer(ctx, *pCreateInfo, &pBuffers[first + i], NULL,
+                              false, batch, &image);
+      }
+      EndImportBatch(ctx, batch);
+    }
+    return result;
+  }
+
+  PendingImports imports(ctx->arena);
+  if (!imports.reserve(bufferCount)) {
+    ALOGE("%s: out of host memory", __func__);
+    return VK_ERROR_OUT_OF_HOST_MEMORY;
+  }
+  for (uint32_t i = 0; i < bufferCount; i++) {
+    const native_handle_t* handle =
+        reinterpret_cast<const native_handle_t*>(pBuffers[i].handle);
+    PendingImport import;
+    import.imageInfo = *pCreateInfo;
+    import.imageInfo.pNext = NULL;
+    import.imageInfo.queueFamilyIndexCount = 0;
+    import.imageInfo.pQueueFamilyIndices = NULL;
+    import.handle = native_handle_clone(handle);
+    if (!import.handle) {
+      ALOGE("%s: failed to clone buffer handle", __func__);
+      for (PendingImport& cloned : imports)
+        FreePendingImport(&cloned);
+      return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+    // for other formats gralloc never sees the clone, and a clone gralloc
+    // refuses still imports with the layout of its format
+    import.registered = IsPlanarFormat(pCreateInfo->format) &&
+                        RegisterGrallocBuffer(import.handle);
+    import.buffer = pBuffers[i];
+    import.buffer.pNext = NULL;
+    import.buffer.handle = import.handle;
+    // can not fail, the space is reserved
+    imports.push_back(std::move(import));
+  }
+
+  ImportQueue* queue = ctx->importQueue;
+  {
+    std::lock_guard<std::mutex> lock(queue->lock);
+    if (!queue->pending.reserve(queue->pending.size() + imports.size())) {
+      ALOGE("%s: out of host memory", __func__);
+      for (PendingImport& cloned : imports)
+        FreePendingImport(&cloned);
+      return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+    for (PendingImport& import : imports)
+      queue->pending.push_back(std::move(import));
+    if (!queue->worker.joinable())
+      queue->worker = std::thread(RunImportWorker, ctx);
+  }
+  queue->cond.notify_one();
+
+  return VK_SUCCESS;
+}
+
+ImportQueue* CreateImportQueue(Arena* arena) {
+  ImportQueue* queue = ArenaNew<ImportQueue>(arena, arena);
+  if (!queue)
+    return nullptr;
+  queue->stop = false;
+  return queue;
+}
+
+void DestroyImportQueue(DeviceContext* ctx) {
+  ImportQueue* queue = ctx->importQueue;
+  if (!queue)
+    return;
+  {
+    std::lock_guard<std::mutex> lock(queue->lock);
+    queue->stop = true;
+  }
+  queue->cond.notify_one();
+
+  // the worker finishes the import it is in the middle of, the ones it did
+  // not get to are dropped as nobody can claim them anymore
+  if (queue->worker.joinable())
+    queue->worker.join();
+
+  for (PendingImport& import : queue->pending)
+    FreePendingImport(&import);
+  ArenaDelete(ctx->arena, queue);
+  ctx->importQueue = nullptr;
+}
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_IMPORT_H
+#define VULKAN_IMPORT_H
+
+#define VK_NO_PROTOTYPES 1
+#include <vulkan/vulkan.h>
+#include <vulkan/vk_android_native_buffer.h>
+
+namespace vulkan_hal {
+
+struct Arena;
+struct DeviceContext;
+struct ImportQueue;
+
+// Imports buffer as an image of the format, extent and usage of imageInfo,
+// reusing an earlier import of the same dma-buf. Takes a reference on the
+// image if addReference is set; pre-imports leave it unreferenced in the
+// cache. Multi-planar formats, modifiers other than X tiling and protected
+// buffers need the driver's dma-buf external memory and explicit DRM format
+// modifier support. Protected buffers, marked by GRALLOC_USAGE_PROTECTED or
+// asked for with VK_IMAGE_CREATE_PROTECTED_BIT, are imported as protected
+// images and need a device with a protected queue.
+VkResult ImportNativeBuffer(DeviceContext* ctx,
+                            const VkImageCreateInfo& imageInfo,
+                            const VkNativeBufferANDROID* buffer,
+                            const VkAllocationCallbacks* pAllocator,
+                            bool addReference,
+                            VkImage* pImage);
+
+// Pre-imports bufferCount buffers for the vkCreateImage calls that will name
+// them, see PFN_vkHalPrepareNativeBuffers, identifying their dma-bufs
+// in batches of kMaxPreparedImages. Async imports are handed to the device's
+// import worker, started on first use, which batches the ones waiting when
+// it wakes up.
+VkResult PrepareNativeBuffers(DeviceContext* ctx,
+                              const VkImageCreateInfo* pCreateInfo,
+                              uint32_t bufferCount,
+                              const VkNativeBufferANDROID* pBuffers,
+                              bool async);
+
+ImportQueue* CreateImportQueue(Arena* arena);
+
+// Stops the device's import worker once it finished the import it is in the
+// middle of, drops the async imports it did not get to and frees the queue.
+// Must be called before the image cache is torn down.
+void DestroyImportQueue(DeviceContext* ctx);
+}
+
+#endif
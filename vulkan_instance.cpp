@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <pthread.h>
+#include <cutils/log.h>
+
+#include "vulkan_device.h"
+#include "vulkan_instance.h"
+#include "vulkan_wrapper.h"
+
+namespace vulkan_hal {
+
+namespace {
+
+// Instances are looked up at device creation and for a few physical device
+// queries only, a small table under a lock does.
+const uint32_t kMaxInstances = 8;
+
+struct InstanceSlot {
+  VkInstance instance;
+  // orders the slots by creation, 0 for a free slot
+  uint64_t serial;
+  InstanceProcs procs;
+};
+
+InstanceSlot instanceSlots[kMaxInstances];
+uint64_t instanceSerial;
+pthread_mutex_t instanceSlotsLock = PTHREAD_MUTEX_INITIALIZER;
+
+template <typename PFN>
+PFN GetProc(VkInstance instance, const char* name) {
+  return reinterpret_cast<PFN>(
+      mesa_vulkan::vkGetInstanceProcAddr(instance, name));
+}
+
+}  // namespace
+
+bool RegisterInstance(VkInstance instance) {
+  InstanceProcs procs;
+  procs.createDevice = GetProc<PFN_vkCreateDevice>(instance, "vkCreateDevice");
+  if (!procs.createDevice) {
+    ALOGE("%s: driver has no vkCreateDevice", __func__);
+    return false;
+  }
+  procs.getPhysicalDeviceMemoryProperties =
+      GetProc<PFN_vkGetPhysicalDeviceMemoryProperties>(
+          instance, "vkGetPhysicalDeviceMemoryProperties");
+  procs.getPhysicalDeviceProperties2 =
+      GetProc<PFN_vkGetPhysicalDeviceProperties2KHR>(
+          instance, "vkGetPhysicalDeviceProperties2");
+  procs.getPhysicalDeviceProperties2KHR =
+      GetProc<PFN_vkGetPhysicalDeviceProperties2KHR>(
+          instance, "vkGetPhysicalDeviceProperties2KHR");
+  procs.getPhysicalDeviceFormatProperties2 =
+      GetProc<PFN_vkGetPhysicalDeviceFormatProperties2KHR>(
+          instance, "vkGetPhysicalDeviceFormatProperties2KHR");
+  if (!procs.getPhysicalDeviceFormatProperties2)
+    procs.getPhysicalDeviceFormatProperties2 =
+        GetProc<PFN_vkGetPhysicalDeviceFormatProperties2KHR>(
+            instance, "vkGetPhysicalDeviceFormatProperties2");
+  procs.getPhysicalDeviceExternalSemaphoreProperties =
+      GetProc<PFN_vkGetPhysicalDeviceExternalSemaphorePropertiesKHR>(
+          instance, "vkGetPhysicalDeviceExternalSemaphorePropertiesKHR");
+  if (!procs.getPhysicalDeviceExternalSemaphoreProperties)
+    procs.getPhysicalDeviceExternalSemaphoreProperties =
+        GetProc<PFN_vkGetPhysicalDeviceExternalSemaphorePropertiesKHR>(
+            instance, "vkGetPhysicalDeviceExternalSemaphoreProperties");
+
+  bool registered = false;
+  pthread_mutex_lock(&instanceSlotsLock);
+  for (uint32_t i = 0; i < kMaxInstances && !registered; i++) {
+    if (instanceSlots[i].serial)
+      continue;
+    instanceSlots[i].instance = instance;
+    instanceSlots[i].serial = ++instanceSerial;
+    instanceSlots[i].procs = procs;
+    registered = true;
+  }
+  pthread_mutex_unlock(&instanceSlotsLock);
+
+  ALOGE_IF(!registered, "%s: more than %u instances", __func__,
+           kMaxInstances);
+  return registered;
+}
+
+void UnregisterInstance(VkInstance instance) {
+  pthread_mutex_lock(&instanceSlotsLock);
+  for (uint32_t i = 0; i < kMaxInstances; i++) {
+    if (instanceSlots[i].serial && instanceSlots[i].instance == instance) {
+      instanceSlots[i].serial = 0;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&instanceSlotsLock);
+}
+
+bool GetPhysicalDeviceProcs(VkPhysicalDevice physicalDevice,
+                            InstanceProcs* procs) {
+  const void* dispatch = GetLoaderDispatch(physicalDevice);
+  const InstanceSlot* found = nullptr;
+  pthread_mutex_lock(&instanceSlotsLock);
+  for (uint32_t i = 0; i < kMaxInstances; i++) {
+    const InstanceSlot& slot = instanceSlots[i];
+    if (!slot.serial)
+      continue;
+    // the loader set up the instance's dispatch long before it enumerated
+    // any of its physical devices
+    if (dispatch && GetLoaderDispatch(slot.instance) == dispatch) {
+      found = &slot;
+      break;
+    }
+    if (!found || slot.serial > found->serial)
+      found = &slot;
+  }
+  if (found)
+    *procs = found->procs;
+  pthread_mutex_unlock(&instanceSlotsLock);
+
+  return found != nullptr;
+}
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef VULKAN_INSTANCE_H
+#define VULKAN_INSTANCE_H
+
+#define VK_NO_PROTOTYPES 1
+#include <vulkan/vulkan.h>
+
+namespace vulkan_hal {
+
+// Driver entry points of one VkInstance. Instance level commands can only
+// be resolved through a real instance, not along with the global commands
+// at driver load, so they are looked up when the instance is created.
+// Extension commands Mesa lacks are NULL.
+struct InstanceProcs {
+  PFN_vkCreateDevice createDevice;
+  PFN_vkGetPhysicalDeviceMemoryProperties getPhysicalDeviceMemoryProperties;
+  // the Vulkan 1.1 and the KHR name, each NULL unless the instance has it
+  PFN_vkGetPhysicalDeviceProperties2KHR getPhysicalDeviceProperties2;
+  PFN_vkGetPhysicalDeviceProperties2KHR getPhysicalDeviceProperties2KHR;
+  // the KHR name, or the Vulkan 1.1 one when only that is there
+  PFN_vkGetPhysicalDeviceFormatProperties2KHR
+      getPhysicalDeviceFormatProperties2;
+  PFN_vkGetPhysicalDeviceExternalSemaphorePropertiesKHR
+      getPhysicalDeviceExternalSemaphoreProperties;
+};
+
+// Resolves and records the entry points of a newly created instance.
+// Returns false when too many instances are alive or the driver lacks
+// vkCreateDevice.
+bool RegisterInstance(VkInstance instance);
+
+void UnregisterInstance(VkInstance instance);
+
+// Copies the entry points of the instance physicalDevice was enumerated from
+// to procs. The loader gives physical devices the dispatch pointer of their
+// instance, which tells the instances apart; without a loader, falls back
+// to the most recently created instance. Returns false if there is none.
+bool GetPhysicalDeviceProcs(VkPhysicalDevice physicalDevice,
+                            InstanceProcs* procs);
+}
+
+#endif
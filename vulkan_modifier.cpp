@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <vector>
+#include <cutils/log.h>
+#include <cutils/properties.h>
+#include <hardware/gralloc.h>
+#include <hardware/gralloc1.h>
+
+#include "vulkan_device.h"
+#include "vulkan_modifier.h"
+
+namespace vulkan_hal {
+
+namespace {
+
+// gralloc has no way to pass a modifier in. A gralloc built to take one
+// maps these private usage bits to the tiling it allocates with, and
+// allocates X tiled without any of them:
+//   GRALLOC_USAGE_PRIVATE_0, GRALLOC1_PRODUCER_USAGE_PRIVATE_0: Y tiled
+//   GRALLOC_USAGE_PRIVATE_1, GRALLOC1_PRODUCER_USAGE_PRIVATE_1: linear
+// The device's build says so with ro.vulkan_hal.gralloc_modifiers=1. To
+// any other gralloc the bits mean something else, so without the property
+// they are neither requested nor trusted and every buffer is X tiled. The
+// buffer's gralloc0 usage is all CreateImage gets to see, so it also tells
+// the import which modifier to use.
+struct ModifierUsage {
+  uint64_t modifier;
+  int grallocUsage;
+  uint64_t producerUsage;
+};
+
+const ModifierUsage kModifierUsages[] = {
+    {kI915FormatModYTiled, GRALLOC_USAGE_PRIVATE_0,
+     GRALLOC1_PRODUCER_USAGE_PRIVATE_0},
+    {kDrmFormatModLinear, GRALLOC_USAGE_PRIVATE_1,
+     GRALLOC1_PRODUCER_USAGE_PRIVATE_1},
+};
+
+// In order of preference. Y tiling beats X tiling for sampling and
+// rendering, linear is the last resort. The CCS modifiers need an aux
+// surface gralloc would have to report the offset of, which it has no way
+// to, so they are left out until it does.
+const uint64_t kPreferredModifiers[] = {
+    kI915FormatModYTiled, kI915FormatModXTiled, kDrmFormatModLinear,
+};
+
+struct ModifierConfig {
+  // gralloc honours kModifierUsages
+  bool grallocModifiers;
+  // the display planes scan out Y tiled buffers, set with
+  // ro.vulkan_hal.scanout_y_tiled=1. Otherwise buffers the composer may put
+  // on a plane stay X tiled, which every display engine scans out.
+  bool yTiledScanout;
+};
+
+pthread_once_t configOnce = PTHREAD_ONCE_INIT;
+ModifierConfig config;
+
+void LoadConfig() {
+  config.grallocModifiers =
+      property_get_bool("ro.vulkan_hal.gralloc_modifiers", false);
+  config.yTiledScanout =
+      property_get_bool("ro.vulkan_hal.scanout_y_tiled", false);
+}
+
+const ModifierConfig& GetConfig() {
+  pthread_once(&configOnce, LoadConfig);
+  return config;
+}
+
+VkFormatFeatureFlags GetRequiredFeatures(VkImageUsageFlags usage) {
+  VkFormatFeatureFlags features = 0;
+  if (usage & VK_IMAGE_USAGE_SAMPLED_BIT)
+    features |= VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+  if (usage & VK_IMAGE_USAGE_STORAGE_BIT)
+    features |= VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT;
+  if (usage & VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT)
+    features |= VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT;
+  return features;
+}
+
+}  // namespace
+
+uint64_t ChooseSwapchainModifier(DeviceContext* ctx,
+                                 VkFormat format,
+                                 VkImageUsageFlags usage,
+                                 bool scanout) {
+  const ModifierConfig& modifierConfig = GetConfig();
+  if (!modifierConfig.grallocModifiers ||
+      (scanout && !modifierConfig.yTiledScanout))
+    return kI915FormatModXTiled;
+
+  // only X tiled buffers can be imported without the explicit path
+  if (!ctx->explicitDmaBufImport ||
+      !ctx->getPhysicalDeviceFormatProperties2)
+    return kI915FormatModXTiled;
+
+  VkDrmFormatModifierPropertiesListEXT modifierList = {
+      .sType = VK_STRUCTURE_TYPE_DRM_FORMAT_MODIFIER_PROPERTIES_LIST_EXT,
+      .pNext = NULL,
+      .drmFormatModifierCount = 0,
+      .pDrmFormatModifierProperties = NULL,
+  };
+  VkFormatProperties2KHR properties = {
+      .sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_2_KHR,
+      .pNext = &modifierList,
+      .formatProperties = {},
+  };
+  ctx->getPhysicalDeviceFormatProperties2(ctx->physicalDevice, format,
+                                          &properties);
+  if (!modifierList.drmFormatModifierCount)
+    return kI915FormatModXTiled;
+
+  std::vector<VkDrmFormatModifierPropertiesEXT> modifiers(
+      modifierList.drmFormatModifierCount);
+  modifierList.pDrmFormatModifierProperties = modifiers.data();
+  ctx->getPhysicalDeviceFormatProperties2(ctx->physicalDevice, format,
+                                          &properties);
+
+  const VkFormatFeatureFlags required = GetRequiredFeatures(usage);
+  for (uint64_t preferred : kPreferredModifiers) {
+    for (uint32_t i = 0; i < modifierList.drmFormatModifierCount; i++) {
+      const VkDrmFormatModifierPropertiesEXT& modifier = modifiers[i];
+      if (modifier.drmFormatModifier == preferred &&
+          modifier.drmFormatModifierPlaneCount == 1 &&
+          (modifier.drmFormatModifierTilingFeatures & required) == required)
+        return preferred;
+    }
+  }
+
+  ALOGW("%s: no modifier for format %d usage 0x%x, using X tiling", __func__,
+        format, usage);
+  return kI915FormatModXTiled;
+}
+
+uint64_t GetModifierProducerUsage(uint64_t modifier) {
+  for (const ModifierUsage& usage : kModifierUsages) {
+    if (usage.modifier == modifier)
+      return usage.producerUsage;
+  }
+  return 0;
+}
+
+uint64_t GetBufferModifier(const VkNativeBufferANDROID* buffer) {
+  if (!GetConfig().grallocModifiers)
+    return kI915FormatModXTiled;
+  for (const ModifierUsage& usage : kModifierUsages) {
+    if (buffer->usage & usage.grallocUsage)
+      return usage.modifier;
+  }
+  return kI915FormatModXTiled;
+}
+}
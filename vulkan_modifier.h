@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_MODIFIER_H
+#define VULKAN_MODIFIER_H
+
+#include <stdint.h>
+
+#define VK_NO_PROTOTYPES 1
+#include <vulkan/vulkan.h>
+#include <vulkan/vk_android_native_buffer.h>
+
+namespace vulkan_hal {
+
+struct DeviceContext;
+
+// DRM format modifiers, drm_fourcc.h is not part of the NDK headers.
+const uint64_t kDrmFormatModLinear = 0;
+const uint64_t kI915FormatModXTiled = (1ull << 56) | 1;
+const uint64_t kI915FormatModYTiled = (1ull << 56) | 2;
+
+// Picks the modifier the buffers of a swapchain of format and usage are
+// allocated with, out of the ones the driver supports for that format and
+// usage and gralloc can be asked for. X tiling, which is all
+// vkCreateDmaBufImageINTEL imports, is the fallback when gralloc does not
+// take modifiers, when the driver can not report its modifiers or the
+// device was created without the extensions to import them explicitly,
+// and for scanout buffers unless the display is known to scan out Y tiled
+// ones. See vulkan_modifier.cpp for the gralloc contract.
+uint64_t ChooseSwapchainModifier(DeviceContext* ctx,
+                                 VkFormat format,
+                                 VkImageUsageFlags usage,
+                                 bool scanout);
+
+// The gralloc1 producer usage asking gralloc for modifier.
+uint64_t GetModifierProducerUsage(uint64_t modifier);
+
+// The modifier buffer was allocated with, as told by its gralloc usage. X
+// tiled unless gralloc takes modifiers.
+uint64_t GetBufferModifier(const VkNativeBufferANDROID* buffer);
+}
+
+#endif
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <atomic>
+#include <mutex>
+
+#include "vulkan_arena.h"
+#include "vulkan_device.h"
+#include "vulkan_proc_cache.h"
+#include "vulkan_stats.h"
+#include "vulkan_wrapper.h"
+
+namespace vulkan_hal {
+
+namespace {
+
+struct ProcEntry {
+  uint32_t hash;
+  char* name;
+  PFN_vkVoidFunction proc;
+};
+
+const uint32_t kProcSlotCount = 512;
+
+// Returns the slot holding name, or the empty slot where it belongs.
+std::atomic<ProcEntry*>* ProbeProcCache(std::atomic<ProcEntry*>* slots,
+                                        const char* name,
+                                        uint32_t hash,
+                                        ProcEntry** entry) {
+  for (uint32_t i = 0; i < kProcSlotCount; i++) {
+    std::atomic<ProcEntry*>* slot = &slots[(hash + i) & (kProcSlotCount - 1)];
+    *entry = slot->load(std::memory_order_acquire);
+    if (!*entry)
+      return slot;
+    if ((*entry)->hash == hash && strcmp((*entry)->name, name) == 0)
+      return slot;
+  }
+  return nullptr;
+}
+
+}  // namespace
+
+// Open addressed table of resolved names. Entries are only ever added, and
+// are published with a release store so readers can probe without a lock.
+struct ProcCache {
+  std::atomic<ProcEntry*> slots[kProcSlotCount];
+  // serializes inserts
+  std::mutex lock;
+  uint32_t entryCount;
+};
+
+ProcCache* CreateProcCache(Arena* arena) {
+  ProcCache* cache = ArenaNew<ProcCache>(arena);
+  if (!cache)
+    return nullptr;
+  for (uint32_t i = 0; i < kProcSlotCount; i++)
+    cache->slots[i].store(nullptr, std::memory_order_relaxed);
+  cache->entryCount = 0;
+  return cache;
+}
+
+void DestroyProcCache(DeviceContext* ctx) {
+  ProcCache* cache = ctx->procCache;
+  if (!cache)
+    return;
+  for (uint32_t i = 0; i < kProcSlotCount; i++) {
+    ProcEntry* entry = cache->slots[i].load(std::memory_order_relaxed);
+    if (entry) {
+      ArenaFree(ctx->arena, entry->name, strlen(entry->name) + 1);
+      ArenaDelete(ctx->arena, entry);
+    }
+  }
+  ArenaDelete(ctx->arena, cache);
+  ctx->procCache = nullptr;
+}
+
+PFN_vkVoidFunction GetDriverDeviceProcAddr(VkDevice device, const char* name) {
+  DeviceContext* ctx = GetDeviceContext(device);
+  if (!ctx)
+    return mesa_vulkan::vkGetDeviceProcAddr(device, name);
+
+  ProcCache* cache = ctx->procCache;
+  const uint32_t hash = HashProcName(name);
+  ProcEntry* entry = nullptr;
+
+  if (ProbeProcCache(cache->slots, name, hash, &entry) && entry)
+    return entry->proc;
+
+  PFN_vkVoidFunction proc;
+  {
+    ScopedStat stat(kStatProcResolve, "vkGetDeviceProcAddr");
+    proc = mesa_vulkan::vkGetDeviceProcAddr(device, name);
+  }
+
+  std::lock_guard<std::mutex> lock(cache->lock);
+  // keep the table at most half full so probes for misses stay short
+  if (cache->entryCount >= kProcSlotCount / 2)
+    return proc;
+
+  std::atomic<ProcEntry*>* slot =
+      ProbeProcCache(cache->slots, name, hash, &entry);
+  if (!slot || entry)
+    return proc;
+
+  const size_t nameSize = strlen(name) + 1;
+  entry = ArenaNew<ProcEntry>(ctx->arena);
+  char* entryName = static_cast<char*>(ArenaAllocate(ctx->arena, nameSize));
+  if (!entry || !entryName) {
+    ArenaDelete(ctx->arena, entry);
+    ArenaFree(ctx->arena, entryName, nameSize);
+    return proc;
+  }
+  memcpy(entryName, name, nameSize);
+  entry->hash = hash;
+  entry->name = entryName;
+  entry->proc = proc;
+  slot->store(entry, std::memory_order_release);
+  cache->entryCount++;
+
+  return proc;
+}
+}
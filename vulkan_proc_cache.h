@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_PROC_CACHE_H
+#define VULKAN_PROC_CACHE_H
+
+#include <stdint.h>
+
+#define VK_NO_PROTOTYPES 1
+#include <vulkan/vulkan.h>
+
+namespace vulkan_hal {
+
+// FNV-1a of an entry point name, seed perturbs the starting state.
+constexpr uint32_t HashProcName(const char* name, uint32_t seed = 0) {
+  uint32_t hash = 2166136261u ^ seed;
+  while (*name) {
+    hash ^= static_cast<uint8_t>(*name++);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+struct Arena;
+struct DeviceContext;
+struct ProcCache;
+
+ProcCache* CreateProcCache(Arena* arena);
+void DestroyProcCache(DeviceContext* ctx);
+
+// Resolves name through Mesa's vkGetDeviceProcAddr once per device and
+// returns the remembered result afterwards, NULL results included. Lookups
+// of already resolved names take no lock.
+PFN_vkVoidFunction GetDriverDeviceProcAddr(VkDevice device, const char* name);
+}
+
+#endif
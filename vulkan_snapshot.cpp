@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <elf.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <link.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cutils/log.h>
+
+#include "vulkan_driver.h"
+#include "vulkan_snapshot.h"
+
+namespace vulkan_hal {
+
+namespace {
+
+// installed by the build, where every app domain can read it
+const char kSnapshotPath[] = "/vendor/etc/vulkan_hal_snapshot";
+
+// where the linker looks for the driver libraries of a vendor HAL, in order
+#if defined(__LP64__)
+const char* const kDriverDirs[] = {"/vendor/lib64", "/system/lib64"};
+#else
+const char* const kDriverDirs[] = {"/vendor/lib", "/system/lib"};
+#endif
+
+const uint32_t kSnapshotMagic = 0x53484b56;  // "VKHS"
+const uint32_t kSnapshotVersion = 3;
+// far more than any driver reports, bounds the size check on a file anyone
+// could have put there
+const uint32_t kMaxSnapshotExtensions = 1024;
+
+// the SHA-1 build ids linkers emit by default take 20 bytes
+const uint32_t kMaxBuildIdSize = 32;
+// notes of a shared library: the build id and maybe an ABI tag
+const size_t kMaxNotesSize = 1024;
+
+// Identifies the driver build a snapshot was taken from.
+struct DriverKey {
+  // resolved path of the driver library, as dladdr reports it
+  char driverPath[PATH_MAX];
+  uint32_t buildIdSize;
+  uint8_t buildId[kMaxBuildIdSize];
+};
+
+// Followed by extensionCount VkExtensionProperties.
+struct SnapshotHeader {
+  uint32_t magic;
+  uint32_t version;
+  DriverKey key;
+  uint32_t extensionCount;
+  uint32_t reserved;
+};
+
+size_t AlignNote(size_t size) {
+  return (size + 3) & ~static_cast<size_t>(3);
+}
+
+// Looks for the NT_GNU_BUILD_ID note in the PT_NOTE segment note of fd.
+bool ReadBuildIdNote(int fd, const ElfW(Phdr)& note, DriverKey* key) {
+  uint8_t notes[kMaxNotesSize];
+  const size_t notesSize = static_cast<size_t>(note.p_filesz) < sizeof(notes)
+                               ? static_cast<size_t>(note.p_filesz)
+                               : sizeof(notes);
+  if (pread(fd, notes, notesSize, static_cast<off_t>(note.p_offset)) !=
+      static_cast<ssize_t>(notesSize))
+    return false;
+
+  size_t offset = 0;
+  while (offset + sizeof(ElfW(Nhdr)) <= notesSize) {
+    ElfW(Nhdr) header;
+    memcpy(&header, notes + offset, sizeof(header));
+    const size_t nameOffset = offset + sizeof(header);
+    const size_t descOffset = nameOffset + AlignNote(header.n_namesz);
+    const size_t end = descOffset + AlignNote(header.n_descsz);
+    if (end > notesSize)
+      return false;
+    if (header.n_type == NT_GNU_BUILD_ID && header.n_namesz == sizeof("GNU") &&
+        memcmp(notes + nameOffset, "GNU", sizeof("GNU")) == 0) {
+      if (header.n_descsz == 0 || header.n_descsz > kMaxBuildIdSize)
+        return false;
+      key->buildIdSize = header.n_descsz;
+      memcpy(key->buildId, notes + descOffset, header.n_descsz);
+      return true;
+    }
+    offset = end;
+  }
+  return false;
+}
+
+// Reads the build id of the library at path from its program headers, a
+// few small reads rather than the whole file. Any rebuild of the library
+// gets a new one, unlike its size, and unlike its mtime it is the same on
+// every device running the build.
+bool ReadBuildId(const char* path, DriverKey* key) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+
+  ElfW(Ehdr) header;
+  bool found = false;
+  if (pread(fd, &header, sizeof(header), 0) ==
+          static_cast<ssize_t>(sizeof(header)) &&
+      memcmp(header.e_ident, ELFMAG, SELFMAG) == 0 &&
+      header.e_phentsize == sizeof(ElfW(Phdr))) {
+    for (uint32_t i = 0; i < header.e_phnum && !found; i++) {
+      ElfW(Phdr) program;
+      const off_t offset =
+          static_cast<off_t>(header.e_phoff + i * sizeof(program));
+      if (pread(fd, &program, sizeof(program), offset) !=
+          static_cast<ssize_t>(sizeof(program)))
+        break;
+      if (program.p_type == PT_NOTE)
+        found = ReadBuildIdNote(fd, program, key);
+    }
+  }
+  close(fd);
+  return found;
+}
+
+bool GetDriverKey(const char* driverPath, DriverKey* key) {
+  memset(key, 0, sizeof(*key));
+  if (strlen(driverPath) >= sizeof(key->driverPath))
+    return false;
+  strcpy(key->driverPath, driverPath);
+  if (!ReadBuildId(driverPath, key)) {
+    ALOGW("%s: no build id in %s", __func__, driverPath);
+    return false;
+  }
+  return true;
+}
+
+// Resolves the library the wrapper would load: the first of the driver
+// candidates found on disk. It may still fail to load, in which case the
+// wrapper falls back to another one and the snapshot it writes does not
+// match this key, so the snapshot is just not used.
+bool FindSelectedDriver(char* path) {
+  DriverCandidates candidates;
+  GetDriverCandidates(&candidates);
+
+  for (uint32_t i = 0; i < candidates.count; i++) {
+    for (size_t j = 0; j < sizeof(kDriverDirs) / sizeof(kDriverDirs[0]); j++) {
+      char candidate[PATH_MAX];
+      int length = snprintf(candidate, sizeof(candidate), "%s/%s",
+                            kDriverDirs[j], candidates.names[i]);
+      if (length < 0 || static_cast<size_t>(length) >= sizeof(candidate))
+        continue;
+      // the linker reports the real path, /vendor may be a symlink
+      if (realpath(candidate, path))
+        return true;
+    }
+  }
+
+  return false;
+}
+
+}  // namespace
+
+const VkExtensionProperties* MapExtensionSnapshot(uint32_t* pCount) {
+  char driverPath[PATH_MAX];
+  DriverKey key;
+  if (!FindSelectedDriver(driverPath) || !GetDriverKey(driverPath, &key))
+    return nullptr;
+
+  int fd = open(kSnapshotPath, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return nullptr;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < sizeof(SnapshotHeader)) {
+    close(fd);
+    return nullptr;
+  }
+
+  const size_t size = static_cast<size_t>(st.st_size);
+  void* map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return nullptr;
+
+  const SnapshotHeader* header = static_cast<const SnapshotHeader*>(map);
+  if (header->magic != kSnapshotMagic ||
+      header->version != kSnapshotVersion ||
+      memcmp(&header->key, &key, sizeof(key)) != 0 ||
+      header->extensionCount > kMaxSnapshotExtensions ||
+      size != sizeof(SnapshotHeader) +
+                  header->extensionCount * sizeof(VkExtensionProperties)) {
+    ALOGV("%s: stale snapshot", __func__);
+    munmap(map, size);
+    return nullptr;
+  }
+
+  *pCount = header->extensionCount;
+  return reinterpret_cast<const VkExtensionProperties*>(header + 1);
+}
+
+bool WriteExtensionSnapshot(const char* path,
+                            const VkExtensionProperties* properties,
+                            uint32_t count,
+                            const char* driverPath) {
+  if (count > kMaxSnapshotExtensions)
+    return false;
+
+  SnapshotHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = kSnapshotMagic;
+  header.version = kSnapshotVersion;
+  header.extensionCount = count;
+  if (!GetDriverKey(driverPath, &header.key))
+    return false;
+
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+    return false;
+
+  const size_t extensionsSize = count * sizeof(VkExtensionProperties);
+  bool written =
+      write(fd, &header, sizeof(header)) ==
+          static_cast<ssize_t>(sizeof(header)) &&
+      write(fd, properties, extensionsSize) ==
+          static_cast<ssize_t>(extensionsSize);
+  if (close(fd) != 0)
+    written = false;
+  if (!written)
+    unlink(path);
+  return written;
+}
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_SNAPSHOT_H
+#define VULKAN_SNAPSHOT_H
+
+#define VK_NO_PROTOTYPES 1
+#include <vulkan/vulkan.h>
+
+namespace vulkan_hal {
+
+// On-disk snapshot of what the driver reports without an instance, so that
+// enumerating instance extensions does not have to load Mesa. App domains
+// can not read anything under /data/vendor, so the snapshot is installed
+// read-only under /vendor/etc by the build, see snapshot/Android.mk. It is
+// tied to the path and ELF build id of the driver library it was taken
+// from, and is ignored unless the driver the GPU selects, see
+// GetDriverCandidates, is that same build. Without a matching one every
+// process queries the driver.
+
+// Maps the snapshot read-only and returns its extension list, or NULL if
+// there is no snapshot for the selected driver. The mapping stays for the
+// lifetime of the process.
+const VkExtensionProperties* MapExtensionSnapshot(uint32_t* pCount);
+
+// Writes a snapshot to path of what the driver library at driverPath, the
+// one loaded, reported. For the vulkan_hal_snapshot tool, the HAL itself
+// never writes one. Returns false if the file could not be written.
+bool WriteExtensionSnapshot(const char* path,
+                            const VkExtensionProperties* properties,
+                            uint32_t count,
+                            const char* driverPath);
+}
+
+#endif
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <time.h>
+#include <atomic>
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#include "vulkan_stats.h"
+
+namespace vulkan_hal {
+
+namespace {
+
+struct AtomicCounter {
+  std::atomic<uint64_t> count;
+  std::atomic<uint64_t> totalNs;
+  std::atomic<uint64_t> maxNs;
+};
+
+AtomicCounter counters[kStatCount];
+
+const char* const kStatNames[kStatCount] = {
+    "acquire",
+    "acquire wait",
+    "release",
+    "import cache hit",
+    "import",
+    "proc lookup",
+    "proc resolve",
+    "proc hook",
+    "import pool reuse",
+    "import pool evict",
+    "driver load",
+    "fence signaled",
+    "fence merge",
+};
+
+}  // namespace
+
+uint64_t NowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull +
+         static_cast<uint64_t>(ts.tv_nsec);
+}
+
+void RecordStat(Stat stat, uint64_t ns) {
+  AtomicCounter& counter = counters[stat];
+  counter.count.fetch_add(1, std::memory_order_relaxed);
+  counter.totalNs.fetch_add(ns, std::memory_order_relaxed);
+
+  uint64_t maxNs = counter.maxNs.load(std::memory_order_relaxed);
+  while (ns > maxNs &&
+         !counter.maxNs.compare_exchange_weak(maxNs, ns,
+                                              std::memory_order_relaxed)) {
+  }
+}
+
+void CountStat(Stat stat) {
+  counters[stat].count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void GetStats(HalStats* stats) {
+  for (uint32_t i = 0; i < kStatCount; i++) {
+    stats->counters[i].count =
+        counters[i].count.load(std::memory_order_relaxed);
+    stats->counters[i].totalNs =
+        counters[i].totalNs.load(std::memory_order_relaxed);
+    stats->counters[i].maxNs =
+        counters[i].maxNs.load(std::memory_order_relaxed);
+  }
+}
+
+bool StatsDumpEnabled() {
+  return property_get_bool("debug.vulkan_hal.stats", false);
+}
+
+void DumpStats() {
+  if (!StatsDumpEnabled())
+    return;
+
+  HalStats stats;
+  GetStats(&stats);
+
+  for (uint32_t i = 0; i < kStatCount; i++) {
+    const StatCounter& counter = stats.counters[i];
+    if (!counter.count)
+      continue;
+    ALOGI("%-18s count %" PRIu64 " total %" PRIu64 "us avg %" PRIu64
+          "us max %" PRIu64 "us",
+          kStatNames[i], counter.count, counter.totalNs / 1000,
+          counter.totalNs / counter.count / 1000, counter.maxNs / 1000);
+  }
+}
+}
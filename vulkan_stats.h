@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_STATS_H
+#define VULKAN_STATS_H
+
+#include <stdint.h>
+
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+#include <cutils/trace.h>
+
+namespace vulkan_hal {
+
+// Operations the HAL keeps timing counters for.
+enum Stat {
+  // AcquireImageANDROID as a whole
+  kStatAcquire,
+  // time spent blocked in sync_wait on a native fence
+  kStatAcquireWait,
+  // QueueSignalReleaseImageANDROID as a whole
+  kStatRelease,
+  // CreateImage calls satisfied by the import cache
+  kStatImportCacheHit,
+  // vkCreateDmaBufImageINTEL imports
+  kStatImport,
+  // GetDeviceProcAddr/GetInstanceProcAddr calls, counted only
+  kStatProcLookup,
+  // lookups that had to go to Mesa's vkGetDeviceProcAddr
+  kStatProcResolve,
+  // lookups answered with one of the HAL's own hooks, counted only
+  kStatProcHook,
+  // cache hits on an import no image referenced anymore, counted only
+  kStatImportPoolReuse,
+  // idle imports destroyed to keep the pool bounded, counted only
+  kStatImportPoolEvict,
+  // dlopen of the driver plus resolving its global entry points
+  kStatDriverLoad,
+  // native fences found signaled by polling, so nothing had to wait on,
+  // import or merge them, counted only
+  kStatFenceSignaled,
+  // sync_merge of the fences a present waits on
+  kStatFenceMerge,
+  kStatCount
+};
+
+struct StatCounter {
+  uint64_t count;
+  uint64_t totalNs;
+  uint64_t maxNs;
+};
+
+// Snapshot of all counters since the HAL was loaded.
+struct HalStats {
+  StatCounter counters[kStatCount];
+};
+
+uint64_t NowNs();
+
+void RecordStat(Stat stat, uint64_t ns);
+
+// Bumps the count of stat without timing it, for paths too hot to read the
+// clock on.
+void CountStat(Stat stat);
+
+void GetStats(HalStats* stats);
+
+// Whether the debug.vulkan_hal.stats property asks for stats to be logged.
+bool StatsDumpEnabled();
+
+// Logs the counters when StatsDumpEnabled().
+void DumpStats();
+
+// Times the enclosing scope into stat and marks it as a systrace section.
+class ScopedStat {
+ public:
+  ScopedStat(Stat stat, const char* traceName)
+      : stat_(stat), startNs_(NowNs()) {
+    ATRACE_BEGIN(traceName);
+  }
+
+  ~ScopedStat() {
+    ATRACE_END();
+    RecordStat(stat_, NowNs() - startNs_);
+  }
+
+  ScopedStat(const ScopedStat&) = delete;
+  ScopedStat& operator=(const ScopedStat&) = delete;
+
+ private:
+  Stat stat_;
+  uint64_t startNs_;
+};
+}
+
+#endif
@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <unistd.h>
+#include <mutex>
+#include <utility>
+#include <cutils/log.h>
+
+#include "vulkan_arena.h"
+#include "vulkan_device.h"
+#include "vulkan_fence.h"
+#include "vulkan_stats.h"
+#include "vulkan_timing.h"
+
+namespace vulkan_hal {
+
+namespace {
+
+// The pending fences are dups of the ones handed to Mesa and the
+// compositor, read once they signaled. At most two per image are open.
+struct ImageTiming {
+  VkImage image;
+  VkHalNativeBufferTiming timing;
+  FenceFd acquireFence;
+  FenceFd releaseFence;
+};
+
+typedef ArenaVector<ImageTiming> ImageTimings;
+
+ImageTiming* FindTiming(ImageTimings* timings, VkImage image) {
+  for (ImageTiming& timing : *timings) {
+    if (timing.image == image)
+      return &timing;
+  }
+  return nullptr;
+}
+
+// Returns NULL when out of host memory, the image then goes without
+// timings.
+ImageTiming* GetTiming(ImageTimings* timings, VkImage image) {
+  ImageTiming* timing = FindTiming(timings, image);
+  if (timing)
+    return timing;
+  if (!timings->push_back({image, {0, 0, 0}, FenceFd(), FenceFd()})) {
+    ALOGE("%s: out of host memory for present timing", __func__);
+    return nullptr;
+  }
+  return &timings->back();
+}
+
+// Fills in the signal time of fence once it signaled and closes it,
+// returns whether it did.
+bool ResolveFence(FenceFd* fence, uint64_t* ns) {
+  if (fence->Get() < 0)
+    return true;
+  if (!fence->GetSignalTime(ns))
+    return false;
+  fence->Reset();
+  return true;
+}
+
+FenceFd DupFence(int fd) {
+  FenceFd fence(dup(fd));
+  ALOGE_IF(fence.Get() < 0, "%s: failed to dup fence for timing: %d",
+           __func__, errno);
+  return fence;
+}
+
+}  // namespace
+
+struct PresentTimings {
+  explicit PresentTimings(Arena* arena)
+      : images(arena) {}
+
+  std::mutex lock;
+  ImageTimings images;
+};
+
+PresentTimings* CreatePresentTimings(Arena* arena) {
+  return ArenaNew<PresentTimings>(arena, arena);
+}
+
+void DestroyPresentTimings(DeviceContext* ctx) {
+  ArenaDelete(ctx->arena, ctx->presentTimings);
+  ctx->presentTimings = nullptr;
+}
+
+void RecordAcquireTiming(DeviceContext* ctx,
+                         VkImage image,
+                         const FenceFd& fence) {
+  // the common case of a fence that already signaled needs no dup
+  uint64_t signalNs = 0;
+  FenceFd pending;
+  if (fence.Get() >= 0 && !fence.GetSignalTime(&signalNs))
+    pending = DupFence(fence.Get());
+
+  PresentTimings* timings = ctx->presentTimings;
+  FenceFd stale;
+  std::lock_guard<std::mutex> lock(timings->lock);
+  ImageTiming* timing = GetTiming(&timings->images, image);
+  if (!timing)
+    return;
+  timing->timing.acquireFenceTime = signalNs;
+  stale = std::move(timing->acquireFence);
+  timing->acquireFence = std::move(pending);
+}
+
+void RecordReleaseTiming(DeviceContext* ctx,
+                         VkImage image,
+                         int fence,
+                         bool submitted) {
+  const uint64_t queueNs = NowNs();
+  FenceFd pending;
+  if (submitted && fence >= 0)
+    pending = DupFence(fence);
+
+  PresentTimings* timings = ctx->presentTimings;
+  FenceFd stale;
+  std::lock_guard<std::mutex> lock(timings->lock);
+  ImageTiming* timing = GetTiming(&timings->images, image);
+  if (!timing)
+    return;
+  timing->timing.releaseQueueTime = queueNs;
+  // without a fence the GPU was done before the release returned
+  timing->timing.gpuCompleteTime = submitted && fence < 0 ? NowNs() : 0;
+  stale = std::move(timing->releaseFence);
+  timing->releaseFence = std::move(pending);
+}
+
+void DropPresentTiming(DeviceContext* ctx, VkImage image) {
+  PresentTimings* timings = ctx->presentTimings;
+  // closed once the lock is dropped
+  ImageTiming dropped = {VK_NULL_HANDLE, {0, 0, 0}, FenceFd(), FenceFd()};
+  std::lock_guard<std::mutex> lock(timings->lock);
+  ImageTiming* timing = FindTiming(&timings->images, image);
+  if (!timing)
+    return;
+  dropped = std::move(*timing);
+  *timing = std::move(timings->images.back());
+  timings->images.pop_back();
+}
+
+VkResult GetNativeBufferTiming(DeviceContext* ctx,
+                               VkImage image,
+                               VkHalNativeBufferTiming* pTiming) {
+  PresentTimings* timings = ctx->presentTimings;
+  *pTiming = {0, 0, 0};
+  std::lock_guard<std::mutex> lock(timings->lock);
+  ImageTiming* timing = FindTiming(&timings->images, image);
+  if (!timing)
+    return VK_NOT_READY;
+
+  const bool acquired =
+      ResolveFence(&timing->acquireFence, &timing->timing.acquireFenceTime);
+  const bool completed =
+      ResolveFence(&timing->releaseFence, &timing->timing.gpuCompleteTime);
+  *pTiming = timing->timing;
+  return acquired && completed && timing->timing.releaseQueueTime
+             ? VK_SUCCESS
+             : VK_NOT_READY;
+}
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_TIMING_H
+#define VULKAN_TIMING_H
+
+#define VK_NO_PROTOTYPES 1
+#include <vulkan/vulkan.h>
+
+#include "vulkan_hal_ext.h"
+
+namespace vulkan_hal {
+
+struct Arena;
+struct DeviceContext;
+class FenceFd;
+struct PresentTimings;
+
+PresentTimings* CreatePresentTimings(Arena* arena);
+
+// Closes the fences still held for timing and frees the table.
+void DestroyPresentTimings(DeviceContext* ctx);
+
+// Notes the acquire fence of image, read right away if it already signaled
+// and kept as a dup until it did otherwise.
+void RecordAcquireTiming(DeviceContext* ctx,
+                         VkImage image,
+                         const FenceFd& fence);
+
+// Starts the timing of a present of image whose release fence is fence,
+// kept as a dup until it signaled. With submitted unset the present had no
+// GPU work and fence is not about the GPU, it is then left without a GPU
+// completion time. -1 otherwise marks a release that waited on the CPU,
+// complete by the time it returns.
+void RecordReleaseTiming(DeviceContext* ctx,
+                         VkImage image,
+                         int fence,
+                         bool submitted);
+
+// Forgets image, which is being destroyed.
+void DropPresentTiming(DeviceContext* ctx, VkImage image);
+
+// Implements PFN_vkHalGetNativeBufferTiming.
+VkResult GetNativeBufferTiming(DeviceContext* ctx,
+                               VkImage image,
+                               VkHalNativeBufferTiming* pTiming);
+}
+
+#endif
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cutils/log.h>
+#include <hardware/gralloc.h>
+#include <hardware/gralloc1.h>
+
+#include "vulkan_format.h"
+#include "vulkan_modifier.h"
+#include "vulkan_usage.h"
+
+namespace vulkan_hal {
+
+namespace {
+
+// usages reading the image on the GPU
+const VkImageUsageFlags kTextureUsage =
+    VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT |
+    VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+
+// usages writing the image on the GPU
+const VkImageUsageFlags kRenderUsage = VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                                       VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                                       VK_IMAGE_USAGE_STORAGE_BIT;
+
+const VkSwapchainImageUsageFlagsANDROID kKnownSwapchainImageUsage =
+    VK_SWAPCHAIN_IMAGE_USAGE_SHARED_BIT_ANDROID;
+
+// gralloc1 bits GetSwapchainGrallocUsage2 sets and their gralloc0 meaning
+struct UsageBit {
+  uint64_t gralloc1;
+  int gralloc0;
+};
+
+const UsageBit kConsumerUsageBits[] = {
+    {GRALLOC1_CONSUMER_USAGE_GPU_TEXTURE, GRALLOC_USAGE_HW_TEXTURE},
+    {GRALLOC1_CONSUMER_USAGE_HWCOMPOSER, GRALLOC_USAGE_HW_COMPOSER},
+};
+
+const UsageBit kProducerUsageBits[] = {
+    {GRALLOC1_PRODUCER_USAGE_GPU_RENDER_TARGET, GRALLOC_USAGE_HW_RENDER},
+    // tiling requests, see vulkan_modifier.cpp
+    {GRALLOC1_PRODUCER_USAGE_PRIVATE_0, GRALLOC_USAGE_PRIVATE_0},
+    {GRALLOC1_PRODUCER_USAGE_PRIVATE_1, GRALLOC_USAGE_PRIVATE_1},
+};
+
+}  // namespace
+
+VkResult GetSwapchainGrallocUsage2(
+    DeviceContext* ctx,
+    VkFormat format,
+    VkImageUsageFlags usage,
+    VkSwapchainImageUsageFlagsANDROID swapchainImageUsage,
+    uint64_t* grallocConsumerUsage,
+    uint64_t* grallocProducerUsage) {
+  const FormatInfo* info = FindFormatInfo(format);
+  if (!info) {
+    ALOGE("%s: no swapchain support for format %d", __func__, format);
+    return VK_ERROR_FORMAT_NOT_SUPPORTED;
+  }
+
+  if (swapchainImageUsage & ~kKnownSwapchainImageUsage) {
+    ALOGE("%s: unknown swapchain image usage 0x%x", __func__,
+          swapchainImageUsage);
+    return VK_ERROR_FORMAT_NOT_SUPPORTED;
+  }
+
+  uint64_t consumer = 0;
+  uint64_t producer = 0;
+
+  // used for texturing
+  if (usage & kTextureUsage)
+    consumer |= GRALLOC1_CONSUMER_USAGE_GPU_TEXTURE;
+
+  // used for rendering
+  if (usage & kRenderUsage)
+    producer |= GRALLOC1_PRODUCER_USAGE_GPU_RENDER_TARGET;
+
+  // Let the composer place the buffer on an overlay plane. CLIENT_TARGET is
+  // left to SurfaceFlinger's own framebuffer target, an app buffer asking
+  // for it would be allocated out of the framebuffer heap.
+  if (info->scanout)
+    consumer |= GRALLOC1_CONSUMER_USAGE_HWCOMPOSER;
+
+  // A shared presentable image is read by the composer while the GPU keeps
+  // rendering to it. In continuous refresh mode it is scanned out without
+  // waiting for any release fence, so it stays X tiled, which every display
+  // engine scans out. Demand refresh presents are ordered by the release
+  // fence each present exports.
+  if (!(swapchainImageUsage & VK_SWAPCHAIN_IMAGE_USAGE_SHARED_BIT_ANDROID))
+    producer |= GetModifierProducerUsage(
+        ChooseSwapchainModifier(ctx, format, usage, info->scanout));
+
+  // no CPU usage on either side, the buffers are never mapped
+
+  *grallocConsumerUsage = consumer;
+  *grallocProducerUsage = producer;
+  return VK_SUCCESS;
+}
+
+VkResult GetSwapchainGrallocUsage(DeviceContext* ctx,
+                                  VkFormat format,
+                                  VkImageUsageFlags usage,
+                                  int* grallocUsage) {
+  uint64_t consumer;
+  uint64_t producer;
+  VkResult result =
+      GetSwapchainGrallocUsage2(ctx, format, usage, 0, &consumer, &producer);
+  if (result != VK_SUCCESS)
+    return result;
+
+  int grallocBits = *grallocUsage;
+  for (const UsageBit& bit : kConsumerUsageBits) {
+    if (consumer & bit.gralloc1)
+      grallocBits |= bit.gralloc0;
+  }
+  for (const UsageBit& bit : kProducerUsageBits) {
+    if (producer & bit.gralloc1)
+      grallocBits |= bit.gralloc0;
+  }
+
+  // never mapped on the CPU
+  grallocBits &= ~(GRALLOC_USAGE_SW_READ_MASK | GRALLOC_USAGE_SW_WRITE_MASK);
+
+  *grallocUsage = grallocBits;
+  return VK_SUCCESS;
+}
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_USAGE_H
+#define VULKAN_USAGE_H
+
+#include <stdint.h>
+
+#define VK_NO_PROTOTYPES 1
+#include <vulkan/vulkan.h>
+#include <vulkan/vk_android_native_buffer.h>
+
+namespace vulkan_hal {
+
+struct DeviceContext;
+
+// Maps the format and usage of a swapchain to the gralloc1 consumer and
+// producer usage its buffers get allocated with. The buffers are only ever
+// touched by the GPU and the display, so no CPU access is requested, which
+// lets gralloc pick tiled, compressed, uncached memory; formats the display
+// can scan out are flagged for the composer so SurfaceFlinger can put them
+// on an overlay plane. The tiling is negotiated with the driver, see
+// ChooseSwapchainModifier, which keeps those X tiled unless the display is
+// known to scan out Y tiling. Shared presentable images always stay X
+// tiled.
+// Fails with VK_ERROR_FORMAT_NOT_SUPPORTED for formats CreateImage can not
+// import.
+VkResult GetSwapchainGrallocUsage2(
+    DeviceContext* ctx,
+    VkFormat format,
+    VkImageUsageFlags usage,
+    VkSwapchainImageUsageFlagsANDROID swapchainImageUsage,
+    uint64_t* grallocConsumerUsage,
+    uint64_t* grallocProducerUsage);
+
+// The same mapping folded into the single gralloc0 usage of
+// vkGetSwapchainGrallocUsageANDROID. grallocUsage is in/out, CPU access the
+// caller asked for is dropped.
+VkResult GetSwapchainGrallocUsage(DeviceContext* ctx,
+                                  VkFormat format,
+                                  VkImageUsageFlags usage,
+                                  int* grallocUsage);
+}
+
+#endif
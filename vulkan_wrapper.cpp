@@ -15,22 +15,53 @@
  */
 
 #include <dlfcn.h>
+#include <limits.h>
+#include <pthread.h>
+#include <string.h>
+#include <atomic>
 #include <cutils/log.h>
 
+#include "vulkan_driver.h"
+#include "vulkan_stats.h"
 #include "vulkan_wrapper.h"
 
 namespace mesa_vulkan {
 
 static void* LibraryHandle = NULL;
+// resolved path of LibraryHandle, protected by LoadLock
+static char LibraryPath[PATH_MAX];
+
+// Set with a release store once the driver is loaded and all entry points
+// are resolved. The entry points are only written before that and only
+// cleared once nobody holds a reference, so after InitializeVulkan returned
+// true they can be called without any further synchronization.
+static std::atomic<bool> Loaded(false);
+static pthread_mutex_t LoadLock = PTHREAD_MUTEX_INITIALIZER;
+// open hw devices plus live instances, protected by LoadLock
+static uint32_t RefCount = 0;
+
+static void ClearEntryPoints() {
+  vkEnumerateInstanceExtensionProperties = NULL;
+  vkCreateInstance = NULL;
+  vkGetInstanceProcAddr = NULL;
+  vkGetDeviceProcAddr = NULL;
+  LibraryPath[0] = '\0';
+}
 
-bool InitializeVulkan() {
-  if (LibraryHandle)
-    return true;
-
-  LibraryHandle = dlopen("libvulkan_intel.so", RTLD_NOW);
+// Loads name and resolves the entry points, leaving LibraryHandle to the
+// caller to close on failure. A missing library is only an error when
+// there is nothing left to fall back to.
+static bool LoadDriverLibrary(const char* name, bool lastResort) {
+  // Bionic binds every relocation at dlopen whatever the flags say, the
+  // time saved for apps that only probe for Vulkan comes from deferring
+  // the dlopen itself to first use.
+  LibraryHandle = dlopen(name, RTLD_NOW);
 
   if (LibraryHandle == NULL) {
-    ALOGE("Failed to load Vulkan library. %s", dlerror());
+    if (lastResort)
+      ALOGE("Failed to load Vulkan library %s. %s", name, dlerror());
+    else
+      ALOGV("Failed to load Vulkan library %s. %s", name, dlerror());
     return false;
   }
 
@@ -67,18 +98,88 @@ bool InitializeVulkan() {
     return false;
   }
 
+  // name is whatever the candidate list says, the linker knows which file
+  // it actually opened
+  Dl_info info;
+  if (dladdr(reinterpret_cast<void*>(vkGetInstanceProcAddr), &info) &&
+      info.dli_fname && strlen(info.dli_fname) < sizeof(LibraryPath))
+    strcpy(LibraryPath, info.dli_fname);
+
   return true;
 }
 
+// Tries the builds optimized for the GPU before the generic one, a build
+// that fails to load or lacks an entry point is skipped.
+static bool LoadDriver() {
+  vulkan_hal::DriverCandidates candidates;
+  vulkan_hal::GetDriverCandidates(&candidates);
+
+  for (uint32_t i = 0; i < candidates.count; i++) {
+    const char* name = candidates.names[i];
+    const bool lastResort = i + 1 == candidates.count;
+    if (LoadDriverLibrary(name, lastResort)) {
+      if (!lastResort)
+        ALOGI("Loaded Vulkan driver %s", name);
+      return true;
+    }
+    ClearEntryPoints();
+    if (LibraryHandle) {
+      dlclose(LibraryHandle);
+      LibraryHandle = NULL;
+    }
+  }
+
+  return false;
+}
+
+bool InitializeVulkan() {
+  if (Loaded.load(std::memory_order_acquire))
+    return true;
+
+  pthread_mutex_lock(&LoadLock);
+  bool loaded = Loaded.load(std::memory_order_relaxed);
+  if (!loaded) {
+    vulkan_hal::ScopedStat stat(vulkan_hal::kStatDriverLoad, "LoadDriver");
+    loaded = LoadDriver();
+    if (loaded) {
+      Loaded.store(true, std::memory_order_release);
+    } else if (LibraryHandle) {
+      dlclose(LibraryHandle);
+      LibraryHandle = NULL;
+    }
+  }
+  pthread_mutex_unlock(&LoadLock);
+
+  return loaded;
+}
+
+void Open() {
+  pthread_mutex_lock(&LoadLock);
+  RefCount++;
+  pthread_mutex_unlock(&LoadLock);
+}
+
 void Close() {
-  if (LibraryHandle) {
+  pthread_mutex_lock(&LoadLock);
+  if (RefCount == 0) {
+    ALOGE("%s: unbalanced close", __func__);
+  } else if (--RefCount == 0 && LibraryHandle) {
+    Loaded.store(false, std::memory_order_relaxed);
     dlclose(LibraryHandle);
     LibraryHandle = NULL;
-    vkEnumerateInstanceExtensionProperties = NULL;
-    vkCreateInstance = NULL;
-    vkGetInstanceProcAddr = NULL;
-    vkGetDeviceProcAddr = NULL;
+    ClearEntryPoints();
   }
+  pthread_mutex_unlock(&LoadLock);
+}
+
+bool GetDriverPath(char* path, size_t size) {
+  pthread_mutex_lock(&LoadLock);
+  const size_t length = strlen(LibraryPath);
+  const bool copied = length > 0 && length < size;
+  if (copied)
+    memcpy(path, LibraryPath, length + 1);
+  pthread_mutex_unlock(&LoadLock);
+  return copied;
 }
 
 PFN_vkCreateInstance vkCreateInstance;
@@ -17,13 +17,28 @@
 #ifndef VULKAN_WRAPPER_H
 #define VULKAN_WRAPPER_H
 
+#include <stddef.h>
+
 #define VK_NO_PROTOTYPES 1
 #include <vulkan/vulkan.h>
 
 namespace mesa_vulkan {
+// Loads the driver build for the GPU, see vulkan_hal::GetDriverCandidates,
+// and resolves the entry points below. Called on first use rather than when
+// the HAL is opened; calls after the first successful one only do an
+// acquire load.
 bool InitializeVulkan();
+
+// Reference the driver for as long as something may still call into it,
+// that is an open hw device or a live instance. The driver is unloaded when
+// the last reference is dropped.
+void Open();
 void Close();
 
+// Copies the resolved path of the loaded driver library to path. Returns
+// false if no driver is loaded or the path does not fit.
+bool GetDriverPath(char* path, size_t size);
+
 extern PFN_vkGetInstanceProcAddr vkGetInstanceProcAddr;
 extern PFN_vkGetDeviceProcAddr vkGetDeviceProcAddr;
 extern PFN_vkCreateInstance vkCreateInstance;